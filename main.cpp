@@ -1,6 +1,121 @@
 #include "raylib.h"
 #include "raymath.h"
+#include "rlgl.h"
 #include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <new>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+// Heap allocation counter: debug builds route C++ allocations through a
+// counter so steady-state frames can be checked for zero heap traffic
+#ifndef NDEBUG
+static std::atomic<size_t> heapAllocationCount(0);  // Both threads allocate
+
+// Out of line on both sides: once malloc or free is inlined into the
+// overrides, GCC pairs them with new/delete and warns about a mismatch
+#if defined(_MSC_VER)
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+static NOINLINE void* AllocateCounted(size_t size) {
+    heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+static NOINLINE void FreeCounted(void* memory) {
+    free(memory);
+}
+
+void* operator new(size_t size) {
+    void* memory = AllocateCounted(size);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+
+void operator delete(void* memory) noexcept { FreeCounted(memory); }
+void operator delete(void* memory, size_t) noexcept { FreeCounted(memory); }
+#endif
+
+size_t GetHeapAllocationCount(void) {
+#ifndef NDEBUG
+    return heapAllocationCount.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+// Per-frame linear arena for transient data: bump allocation, reset at the top
+// of every frame. Requests that don't fit fall back to the heap for this frame
+// and the arena grows to the frame's peak at the next reset.
+struct FrameArena {
+    unsigned char* memory;
+    size_t capacity;
+    size_t used;
+    size_t peak;        // Bytes requested this frame, including overflow
+    void* overflow;     // Heap blocks handed out this frame, linked through their first word
+};
+
+void InitFrameArena(FrameArena& arena, size_t capacity) {
+    arena.memory = (unsigned char*)malloc(capacity);
+    arena.capacity = capacity;
+    arena.used = arena.peak = 0;
+    arena.overflow = NULL;
+}
+
+void* ArenaAlloc(FrameArena& arena, size_t size, size_t align) {
+    size_t offset = (arena.used + align - 1) & ~(align - 1);
+    arena.peak += size + align;
+    if (offset + size <= arena.capacity) {
+        arena.used = offset + size;
+        return arena.memory + offset;
+    }
+    
+    // Overflow block: header keeps the list, payload aligned after it
+    size_t header = (sizeof(void*) + align - 1) & ~(align - 1);
+    unsigned char* block = (unsigned char*)malloc(header + size);
+#ifndef NDEBUG
+    heapAllocationCount++;
+#endif
+    *(void**)block = arena.overflow;
+    arena.overflow = block;
+    return block + header;
+}
+
+template <typename T>
+T* ArenaAllocArray(FrameArena& arena, size_t count) {
+    return (T*)ArenaAlloc(arena, sizeof(T) * (count > 0 ? count : 1), alignof(T));
+}
+
+void ResetFrameArena(FrameArena& arena) {
+    while (arena.overflow) {
+        void* next = *(void**)arena.overflow;
+        free(arena.overflow);
+        arena.overflow = next;
+    }
+    if (arena.peak > arena.capacity) {
+        size_t capacity = arena.capacity;
+        while (capacity < arena.peak) capacity *= 2;
+        free(arena.memory);
+        arena.memory = (unsigned char*)malloc(capacity);
+        arena.capacity = capacity;
+    }
+    arena.used = arena.peak = 0;
+}
+
+void UnloadFrameArena(FrameArena& arena) {
+    ResetFrameArena(arena);
+    free(arena.memory);
+    arena.memory = NULL;
+    arena.capacity = 0;
+}
 
 // Game modes
 enum GameMode {
@@ -8,7 +123,8 @@ enum GameMode {
     WORLD_EDITING_MODE
 };
 
-// Block structure
+// Block structure. Only dynamic blocks use this full layout, so velocity and
+// health stay inline: the solver and the sleep pass walk them together.
 struct Block {
     Vector3 position;
     Vector3 velocity;
@@ -18,43 +134,408 @@ struct Block {
     float maxHealth;
 };
 
-// Button helper struct
-struct Button {
-    Rectangle bounds;
-    const char* text;
+// Static blocks never move and have no health (only a hard impact breaks one
+// outright), so they are stored packed: a half-unit grid position and a
+// palette colour index (7 bytes, 8 with padding).
+// They expand to a full Block when the editor or undo needs one.
+struct StaticBlock {
+    short x, y, z;          // Position in half units
+    unsigned char palette;  // Index into StaticWorld::palette
+};
+
+Vector3 GetBlockCenter(const Block& block) {
+    return block.position;
+}
+
+Vector3 GetBlockCenter(const StaticBlock& block) {
+    return (Vector3){ block.x * 0.5f, block.y * 0.5f, block.z * 0.5f };
+}
+
+// Recorded input: every key, button and mouse value the game reads in a frame.
+// Live frames are captured from raylib; replays read them back from a file.
+const int inputKeys[] = {
+    KEY_W, KEY_A, KEY_S, KEY_D, KEY_SPACE, KEY_E, KEY_Q, KEY_TAB,
+    KEY_ONE, KEY_TWO, KEY_THREE, KEY_Z, KEY_Y,
+    KEY_LEFT_CONTROL, KEY_RIGHT_CONTROL, KEY_LEFT_SHIFT, KEY_RIGHT_SHIFT, KEY_G
+};
+const int inputKeyCount = sizeof(inputKeys) / sizeof(inputKeys[0]);
+
+// Fixed 36-byte layout, written to replay files as is
+struct FrameInput {
+    float deltaTime;
+    unsigned int keysDown;      // Bit per entry of inputKeys
+    unsigned int keysPressed;
+    unsigned int mouseButtons;  // Bits 0-2 down, 3-5 pressed, 6-8 released
+    Vector2 mousePosition;
+    Vector2 mouseDelta;
+    float mouseWheel;
+};
+
+FrameInput CaptureFrameInput(void) {
+    FrameInput input = { 0 };
+    input.deltaTime = GetFrameTime();
+    for (int k = 0; k < inputKeyCount; k++) {
+        if (IsKeyDown(inputKeys[k])) input.keysDown |= 1u << k;
+        if (IsKeyPressed(inputKeys[k])) input.keysPressed |= 1u << k;
+    }
+    for (int b = 0; b < 3; b++) {
+        if (IsMouseButtonDown(b)) input.mouseButtons |= 1u << b;
+        if (IsMouseButtonPressed(b)) input.mouseButtons |= 1u << (b + 3);
+        if (IsMouseButtonReleased(b)) input.mouseButtons |= 1u << (b + 6);
+    }
+    input.mousePosition = GetMousePosition();
+    input.mouseDelta = GetMouseDelta();
+    input.mouseWheel = GetMouseWheelMove();
+    return input;
+}
+
+unsigned int GetInputKeyBit(int key) {
+    for (int k = 0; k < inputKeyCount; k++) {
+        if (inputKeys[k] == key) return 1u << k;
+    }
+    return 0;
+}
+
+bool IsInputKeyDown(const FrameInput& input, int key) { return (input.keysDown & GetInputKeyBit(key)) != 0; }
+bool IsInputKeyPressed(const FrameInput& input, int key) { return (input.keysPressed & GetInputKeyBit(key)) != 0; }
+bool IsInputButtonDown(const FrameInput& input, int button) { return (input.mouseButtons & (1u << button)) != 0; }
+bool IsInputButtonPressed(const FrameInput& input, int button) { return (input.mouseButtons & (1u << (button + 3))) != 0; }
+bool IsInputButtonReleased(const FrameInput& input, int button) { return (input.mouseButtons & (1u << (button + 6))) != 0; }
+
+// Replay file: "RPLY", version, RNG seed, then one FrameInput per frame
+struct InputStream {
+    FILE* file;
+    bool recording;
+    bool replaying;
+    unsigned int seed;
+    long long frames;
+};
+
+const unsigned int replayMagic = 0x594C5052; // "RPLY"
+const unsigned int replayVersion = 1;
+
+bool OpenInputRecording(InputStream& stream, const char* fileName, unsigned int seed) {
+    stream.file = fopen(fileName, "wb");
+    if (!stream.file) return false;
+    unsigned int header[3] = { replayMagic, replayVersion, seed };
+    fwrite(header, sizeof(header), 1, stream.file);
+    stream.recording = true;
+    stream.seed = seed;
+    stream.frames = 0;
+    return true;
+}
+
+bool OpenInputReplay(InputStream& stream, const char* fileName) {
+    stream.file = fopen(fileName, "rb");
+    if (!stream.file) return false;
+    unsigned int header[3];
+    if (fread(header, sizeof(header), 1, stream.file) != 1 || 
+        header[0] != replayMagic || header[1] != replayVersion) {
+        fclose(stream.file);
+        stream.file = NULL;
+        return false;
+    }
+    stream.replaying = true;
+    stream.seed = header[2];
+    stream.frames = 0;
+    return true;
+}
+
+void WriteFrameInput(InputStream& stream, const FrameInput& input) {
+    fwrite(&input, sizeof(FrameInput), 1, stream.file);
+    stream.frames++;
+}
+
+// Returns false once the replay runs out of frames
+bool ReadFrameInput(InputStream& stream, FrameInput& input) {
+    if (fread(&input, sizeof(FrameInput), 1, stream.file) != 1) return false;
+    stream.frames++;
+    return true;
+}
+
+void CloseInputStream(InputStream& stream) {
+    if (stream.file) fclose(stream.file);
+    stream.file = NULL;
+    stream.recording = stream.replaying = false;
+}
+
+// Deterministic physics: one fixed step per frame and a world hash after each
+// step, logged or compared against a golden file. Needs a build without
+// -ffast-math or FMA contraction (-ffp-contract=off) to stay bit-exact.
+struct StepChecksum {
+    bool enabled;
+    float fixedStep;
+    long long step;
+    FILE* log;      // Receives "step hash" lines
+    FILE* golden;   // Expected "step hash" lines
+    bool failed;
+};
+
+// Records the hash of a finished step. Returns false on a golden mismatch.
+bool CheckStepChecksum(StepChecksum& checksum, unsigned long long hash) {
+    long long step = checksum.step++;
+    if (checksum.log) fprintf(checksum.log, "%lld %016llx\n", step, hash);
+    if (checksum.golden) {
+        long long goldenStep;
+        unsigned long long goldenHash;
+        if (fscanf(checksum.golden, "%lld %llx", &goldenStep, &goldenHash) != 2) {
+            TraceLog(LOG_WARNING, "DETERMINISM: Golden file ended before step %lld", step);
+            fclose(checksum.golden);
+            checksum.golden = NULL;
+        } else if (goldenStep != step || goldenHash != hash) {
+            TraceLog(LOG_ERROR, "DETERMINISM: Step %lld hash %016llx differs from golden %016llx", 
+                step, hash, goldenHash);
+            checksum.failed = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Retained HUD text: labels keep their glyph quads, laid out with the default
+// font the way DrawText would, and are laid out again only when their text
+// changes. Numbers feeding a label are compared before anything is formatted,
+// so unchanged values cost neither TextFormat nor layout. Each group of
+// labels draws as one textured quad batch.
+#define HUD_LABEL_CHARS 96
+
+enum HudGroup {
+    HUD_NORMAL,
+    HUD_EDITOR,
+    HUD_PAUSE,
+    HUD_PROFILER,
+    HUD_STATS,
+    HUD_FPS
+};
+
+struct GlyphQuad {
+    Rectangle source;   // Texels in the font atlas
+    Rectangle dest;     // Pixels, relative to the label position
+};
+
+struct HudLabel {
+    char text[HUD_LABEL_CHARS];
+    GlyphQuad quads[HUD_LABEL_CHARS];
+    int quadCount;
+    int width;              // Laid-out width, as MeasureText
+    float values[3];        // Last values seen by HudLabelValuesChanged
+    bool hasValues;
+    Vector2 position;
+    int fontSize;
+    Color color;
+    HudGroup group;
+};
+
+struct HudText {
+    Font font;
+    std::vector<HudLabel> labels;
+    int layouts;            // Labels laid out since the counter was last cleared
+};
+
+void InitHudText(HudText& hud) {
+    hud.font = GetFontDefault();
+    hud.labels.clear();
+    hud.layouts = 0;
+}
+
+void LayoutHudLabel(const Font& font, HudLabel& label) {
+    // DrawText's metrics: the 10px default font scaled, one pixel of spacing per 10px
+    int fontSize = std::max(label.fontSize, 10);
+    float scale = (float)fontSize / font.baseSize;
+    float spacing = (float)(fontSize / 10);
+    float padding = (float)font.glyphPadding;
+    float offset = 0.0f;
+    label.quadCount = 0;
+    
+    for (const char* c = label.text; *c; c++) {
+        int index = GetGlyphIndex(font, *c);
+        Rectangle glyph = font.recs[index];
+        if (*c != ' ') {
+            GlyphQuad& quad = label.quads[label.quadCount++];
+            quad.source = (Rectangle){ glyph.x - padding, glyph.y - padding, glyph.width + 2*padding, glyph.height + 2*padding };
+            quad.dest = (Rectangle){ offset + (font.glyphs[index].offsetX - padding) * scale, 
+                                     (font.glyphs[index].offsetY - padding) * scale, 
+                                     quad.source.width * scale, quad.source.height * scale };
+        }
+        float advance = font.glyphs[index].advanceX ? (float)font.glyphs[index].advanceX : glyph.width;
+        offset += advance * scale + spacing;
+    }
+    label.width = (label.text[0] != '\0') ? (int)(offset - spacing) : 0;
+}
+
+void SetHudLabelText(HudText& hud, int label, const char* text) {
+    HudLabel& hudLabel = hud.labels[label];
+    if (strncmp(hudLabel.text, text, HUD_LABEL_CHARS - 1) == 0) return;
+    strncpy(hudLabel.text, text, HUD_LABEL_CHARS - 1);
+    hudLabel.text[HUD_LABEL_CHARS - 1] = '\0';
+    LayoutHudLabel(hud.font, hudLabel);
+    hud.layouts++;
+}
+
+int AddHudLabel(HudText& hud, HudGroup group, float x, float y, int fontSize, Color color, const char* text) {
+    HudLabel label;
+    label.text[0] = '\0';
+    label.quadCount = 0;
+    label.width = 0;
+    label.hasValues = false;
+    label.position = (Vector2){ x, y };
+    label.fontSize = fontSize;
+    label.color = color;
+    label.group = group;
+    hud.labels.push_back(label);
+    SetHudLabelText(hud, (int)hud.labels.size() - 1, text);
+    return (int)hud.labels.size() - 1;
+}
+
+// A label centred in bounds, for fixed captions
+int AddHudCaption(HudText& hud, HudGroup group, Rectangle bounds, int fontSize, Color color, const char* text) {
+    int label = AddHudLabel(hud, group, 0.0f, 0.0f, fontSize, color, text);
+    hud.labels[label].position = (Vector2){ 
+        (float)(int)(bounds.x + (bounds.width - hud.labels[label].width) / 2), 
+        (float)(int)(bounds.y + (bounds.height - fontSize) / 2) };
+    return label;
+}
+
+// True, and remembered, when the values differ from the last call; the caller
+// then formats the new text
+bool HudLabelValuesChanged(HudText& hud, int label, float a, float b = 0.0f, float c = 0.0f) {
+    HudLabel& hudLabel = hud.labels[label];
+    if (hudLabel.hasValues && hudLabel.values[0] == a && hudLabel.values[1] == b && hudLabel.values[2] == c) return false;
+    hudLabel.values[0] = a;
+    hudLabel.values[1] = b;
+    hudLabel.values[2] = c;
+    hudLabel.hasValues = true;
+    return true;
+}
+
+// Returns the draw calls issued
+int DrawHudText(const HudText& hud, HudGroup group) {
+    int quadCount = 0;
+    for (const HudLabel& label : hud.labels) {
+        if (label.group == group) quadCount += label.quadCount;
+    }
+    if (quadCount == 0) return 0;
+    
+    Texture2D atlas = hud.font.texture;
+    rlCheckRenderBatchLimit(quadCount * 4);
+    rlSetTexture(atlas.id);
+    rlBegin(RL_QUADS);
+    for (const HudLabel& label : hud.labels) {
+        if (label.group != group) continue;
+        rlColor4ub(label.color.r, label.color.g, label.color.b, label.color.a);
+        for (int q = 0; q < label.quadCount; q++) {
+            const GlyphQuad& quad = label.quads[q];
+            float x = label.position.x + quad.dest.x, y = label.position.y + quad.dest.y;
+            float u0 = quad.source.x / atlas.width, v0 = quad.source.y / atlas.height;
+            float u1 = (quad.source.x + quad.source.width) / atlas.width, v1 = (quad.source.y + quad.source.height) / atlas.height;
+            rlTexCoord2f(u0, v0); rlVertex2f(x, y);
+            rlTexCoord2f(u0, v1); rlVertex2f(x, y + quad.dest.height);
+            rlTexCoord2f(u1, v1); rlVertex2f(x + quad.dest.width, y + quad.dest.height);
+            rlTexCoord2f(u1, v0); rlVertex2f(x + quad.dest.width, y);
+        }
+    }
+    rlEnd();
+    rlSetTexture(0);
+    return 1;
+}
+
+// Retained pause menu: widgets are built once with their layout and hit-test
+// rectangles, the pointer is tested once per frame, and the menu is rendered
+// into a texture only when the hovered widget changes. Other frames just draw
+// that texture, so adding widgets costs nothing per frame while idle.
+enum UiAction {
+    UI_NONE,
+    UI_NORMAL_MODE,
+    UI_EDIT_MODE,
+    UI_CONTINUE,
+    UI_EXIT
+};
+
+struct UiWidget {
+    Rectangle bounds;       // Layout and hit-test rectangle
     Color normalColor;
     Color hoverColor;
+    UiAction action;
 };
 
-bool IsButtonHovered(Button button) {
-    Vector2 mousePos = GetMousePosition();
-    return CheckCollisionPointRec(mousePos, button.bounds);
+struct UiMenu {
+    std::vector<UiWidget> widgets;
+    HudGroup captions;      // HUD labels drawn over the widgets
+    int hovered;            // Widget under the pointer, -1 for none
+    bool dirty;             // Texture no longer matches the widgets
+    Vector2 lastPointer;
+    RenderTexture2D target;
+};
+
+void InitUiMenu(UiMenu& menu, int width, int height, HudGroup captions) {
+    menu.widgets.clear();
+    menu.captions = captions;
+    menu.hovered = -1;
+    menu.dirty = true;
+    menu.lastPointer = (Vector2){ -1.0f, -1.0f };
+    menu.target = LoadRenderTexture(width, height);
 }
 
-bool IsButtonClicked(Button button) {
-    return IsButtonHovered(button) && IsMouseButtonPressed(MOUSE_LEFT_BUTTON);
+void UnloadUiMenu(UiMenu& menu) {
+    UnloadRenderTexture(menu.target);
 }
 
-void DrawButton(Button button) {
-    Color buttonColor = IsButtonHovered(button) ? button.hoverColor : button.normalColor;
-    DrawRectangleRec(button.bounds, buttonColor);
-    DrawRectangleLinesEx(button.bounds, 2, BLACK);
-    
-    int textWidth = MeasureText(button.text, 30);
-    DrawText(button.text, 
-        button.bounds.x + (button.bounds.width - textWidth) / 2,
-        button.bounds.y + (button.bounds.height - 30) / 2,
-        30, WHITE);
+void AddUiButton(UiMenu& menu, HudText& hud, Rectangle bounds, const char* text, 
+                 Color normalColor, Color hoverColor, UiAction action) {
+    menu.widgets.push_back(UiWidget{ bounds, normalColor, hoverColor, action });
+    AddHudCaption(hud, menu.captions, bounds, 30, WHITE, text);
+    menu.dirty = true;
+}
+
+// One hit test, skipped while the pointer rests; returns the clicked action
+UiAction UpdateUiMenu(UiMenu& menu, const FrameInput& input) {
+    Vector2 pointer = input.mousePosition;
+    if (pointer.x != menu.lastPointer.x || pointer.y != menu.lastPointer.y) {
+        menu.lastPointer = pointer;
+        int hovered = -1;
+        for (size_t i = 0; i < menu.widgets.size() && hovered < 0; i++) {
+            if (CheckCollisionPointRec(pointer, menu.widgets[i].bounds)) hovered = (int)i;
+        }
+        if (hovered != menu.hovered) {
+            menu.hovered = hovered;
+            menu.dirty = true;
+        }
+    }
+    if (menu.hovered >= 0 && IsInputButtonPressed(input, MOUSE_LEFT_BUTTON)) return menu.widgets[menu.hovered].action;
+    return UI_NONE;
+}
+
+// Returns the draw calls issued
+int DrawUiMenu(UiMenu& menu, const HudText& hud) {
+    int drawCalls = 1;
+    if (menu.dirty) {
+        BeginTextureMode(menu.target);
+            ClearBackground(BLANK);
+            for (size_t i = 0; i < menu.widgets.size(); i++) {
+                const UiWidget& widget = menu.widgets[i];
+                DrawRectangleRec(widget.bounds, ((int)i == menu.hovered) ? widget.hoverColor : widget.normalColor);
+                DrawRectangleLinesEx(widget.bounds, 2, BLACK);
+            }
+            drawCalls += 2 * (int)menu.widgets.size() + DrawHudText(hud, menu.captions);
+        EndTextureMode();
+        menu.dirty = false;
+    }
+    // Render textures are stored upside down
+    Rectangle source = { 0.0f, 0.0f, (float)menu.target.texture.width, -(float)menu.target.texture.height };
+    DrawTextureRec(menu.target.texture, source, (Vector2){ 0.0f, 0.0f }, WHITE);
+    return drawCalls;
 }
 
-BoundingBox GetBlockBoundingBox(Block block, Vector3 size) {
+template <typename T>
+BoundingBox GetBlockBoundingBox(const T& block, Vector3 size) {
+    Vector3 position = GetBlockCenter(block);
     return (BoundingBox){
-        (Vector3){ block.position.x - size.x/2, 
-                   block.position.y - size.y/2, 
-                   block.position.z - size.z/2 },
-        (Vector3){ block.position.x + size.x/2, 
-                   block.position.y + size.y/2, 
-                   block.position.z + size.z/2 }
+        (Vector3){ position.x - size.x/2, 
+                   position.y - size.y/2, 
+                   position.z - size.z/2 },
+        (Vector3){ position.x + size.x/2, 
+                   position.y + size.y/2, 
+                   position.z + size.z/2 }
     };
 }
 
@@ -76,13 +557,3596 @@ Color GetHealthColor(float health, float maxHealth) {
     return RED;
 }
 
-int main() {
+// What the renderer needs of a block; the simulation publishes these so
+// drawing never touches the live world
+struct RenderBlock {
+    Vector3 position;
+    Color color;
+    float healthRatio;  // Health left, 0 to 1
+    bool isStatic;
+};
+
+// Health bars: damaged dynamic blocks in range are projected to the screen
+// once per frame, then every bar is drawn in one 2D batch after the 3D pass
+struct HealthBar {
+    Vector2 position;   // Screen position of the bar centre
+    float ratio;        // Health left, 0 to 1
+    Color color;
+};
+
+// Returns the bars of blocks below full health, within maxDistance, in front
+// of the camera and on screen
+int CollectHealthBars(const std::vector<RenderBlock>& blocks, Camera3D camera, float maxDistance, 
+                      Vector2 barSize, FrameArena& arena, HealthBar** bars) {
+    HealthBar* out = ArenaAllocArray<HealthBar>(arena, blocks.size());
+    Vector3 forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+    float maxDistanceSq = maxDistance * maxDistance;
+    float width = (float)GetScreenWidth(), height = (float)GetScreenHeight();
+    int count = 0;
+    
+    for (const RenderBlock& block : blocks) {
+        if (block.isStatic || block.healthRatio >= 1.0f) continue;
+        Vector3 anchor = { block.position.x, block.position.y + 1.5f, block.position.z };
+        Vector3 toBar = Vector3Subtract(anchor, camera.position);
+        if (Vector3DotProduct(toBar, toBar) > maxDistanceSq || Vector3DotProduct(toBar, forward) <= 0.0f) continue;
+        
+        Vector2 screen = GetWorldToScreen(anchor, camera);
+        if (screen.x < -barSize.x || screen.x > width + barSize.x || screen.y < -barSize.y || screen.y > height + barSize.y) continue;
+        out[count++] = HealthBar{ screen, Clamp(block.healthRatio, 0.0f, 1.0f), GetHealthColor(block.healthRatio, 1.0f) };
+    }
+    *bars = out;
+    return count;
+}
+
+void AddScreenQuad(float x, float y, float width, float height, Color color) {
+    rlColor4ub(color.r, color.g, color.b, color.a);
+    rlVertex2f(x, y);
+    rlVertex2f(x, y + height);
+    rlVertex2f(x + width, y + height);
+    rlVertex2f(x + width, y);
+}
+
+// Returns the draw calls issued
+int DrawHealthBars(const HealthBar* bars, int count, Vector2 barSize) {
+    if (count == 0) return 0;
+    const int chunk = 512;  // Bars per batch check
+    for (int start = 0; start < count; start += chunk) {
+        int end = std::min(start + chunk, count);
+        rlCheckRenderBatchLimit((end - start) * 8);
+        rlBegin(RL_QUADS);
+        for (int i = start; i < end; i++) {
+            float x = bars[i].position.x - barSize.x/2, y = bars[i].position.y - barSize.y/2;
+            AddScreenQuad(x, y, barSize.x, barSize.y, DARKGRAY);
+            AddScreenQuad(x, y, barSize.x * bars[i].ratio, barSize.y, bars[i].color);
+        }
+        rlEnd();
+    }
+    return 1;
+}
+
+// Frame-phase profiler
+enum ProfilePhase {
+    PHASE_INPUT,
+    PHASE_PLAYER,
+    PHASE_KICK,
+    PHASE_INTEGRATE,
+    PHASE_COLLIDE,
+    PHASE_DESTROY,
+    PHASE_CAMERA,
+    PHASE_EDITOR,
+    PHASE_DRAW_3D,
+    PHASE_DRAW_HUD,
+    PHASE_COUNT
+};
+
+const char* phaseNames[PHASE_COUNT] = {
+    "Input", "Player", "Kick", "Integrate", "Collide", 
+    "Destroy", "Camera", "Editor", "Draw 3D", "Draw HUD"
+};
+
+const Color phaseColors[PHASE_COUNT] = {
+    SKYBLUE, GREEN, ORANGE, YELLOW, RED, 
+    MAROON, PURPLE, PINK, BLUE, LIME
+};
+
+#define PROFILE_HISTORY 120          // Frames kept for the rolling overlay
+#define PROFILE_MAX_TRACE 1000000    // Trace events kept before capture stops (reserved up front)
+
+struct PhaseTiming {
+    float start;     // ms from frame start of the first entry this frame
+    float duration;  // ms spent in the phase this frame
+};
+
+struct TraceEvent {
+    int phase;       // PHASE_COUNT marks the whole frame
+    int thread;      // Trace track: 1 main, 2 simulation
+    double start;    // Seconds
+    double duration;
+};
+
+struct FrameProfiler {
+    double frameStart;
+    double phaseBegin[PHASE_COUNT];
+    PhaseTiming current[PHASE_COUNT];
+    PhaseTiming history[PROFILE_HISTORY][PHASE_COUNT];
+    float frameMs[PROFILE_HISTORY];
+    int historyHead;               // Slot the next finished frame goes into
+    bool showOverlay;
+    bool capturing;                // Recording Chrome trace events
+    int traceThread;               // Track this profiler's events go on
+    std::vector<TraceEvent> trace;
+};
+
+void InitFrameProfiler(FrameProfiler& profiler) {
+    profiler.frameStart = 0.0;
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        profiler.phaseBegin[p] = 0.0;
+        profiler.current[p] = (PhaseTiming){ 0.0f, 0.0f };
+        for (int f = 0; f < PROFILE_HISTORY; f++) profiler.history[f][p] = (PhaseTiming){ 0.0f, 0.0f };
+    }
+    for (int f = 0; f < PROFILE_HISTORY; f++) profiler.frameMs[f] = 0.0f;
+    profiler.historyHead = 0;
+    profiler.showOverlay = false;
+    profiler.capturing = false;
+    profiler.traceThread = 1;
+}
+
+// The trace buffer is reserved in full the first time capture starts, so
+// recording never reallocates mid-frame
+void SetProfilerCapture(FrameProfiler& profiler, bool capturing) {
+    if (capturing) profiler.trace.reserve(PROFILE_MAX_TRACE);
+    profiler.capturing = capturing;
+}
+
+void BeginProfileFrame(FrameProfiler& profiler) {
+    profiler.frameStart = GetTime();
+    for (int p = 0; p < PHASE_COUNT; p++) profiler.current[p] = (PhaseTiming){ 0.0f, 0.0f };
+}
+
+void BeginProfilePhase(FrameProfiler& profiler, ProfilePhase phase) {
+    profiler.phaseBegin[phase] = GetTime();
+}
+
+void EndProfilePhase(FrameProfiler& profiler, ProfilePhase phase) {
+    double end = GetTime();
+    double begin = profiler.phaseBegin[phase];
+    PhaseTiming& timing = profiler.current[phase];
+    if (timing.duration == 0.0f) timing.start = (float)((begin - profiler.frameStart) * 1000.0);
+    timing.duration += (float)((end - begin) * 1000.0);
+    
+    if (profiler.capturing && profiler.trace.size() < PROFILE_MAX_TRACE) {
+        profiler.trace.push_back((TraceEvent){ phase, profiler.traceThread, begin, end - begin });
+    }
+}
+
+// Times the enclosing scope
+struct ProfileScope {
+    FrameProfiler& profiler;
+    ProfilePhase phase;
+    ProfileScope(FrameProfiler& profiler, ProfilePhase phase) : profiler(profiler), phase(phase) {
+        BeginProfilePhase(profiler, phase);
+    }
+    ~ProfileScope() { EndProfilePhase(profiler, phase); }
+};
+
+void EndProfileFrame(FrameProfiler& profiler) {
+    double end = GetTime();
+    int slot = profiler.historyHead;
+    for (int p = 0; p < PHASE_COUNT; p++) profiler.history[slot][p] = profiler.current[p];
+    profiler.frameMs[slot] = (float)((end - profiler.frameStart) * 1000.0);
+    profiler.historyHead = (slot + 1) % PROFILE_HISTORY;
+    
+    if (profiler.capturing && profiler.trace.size() < PROFILE_MAX_TRACE) {
+        profiler.trace.push_back((TraceEvent){ PHASE_COUNT, profiler.traceThread, profiler.frameStart, end - profiler.frameStart });
+    }
+}
+
+// Writes captured events in Chrome trace-event format (chrome://tracing, Perfetto)
+bool SaveProfilerTrace(const FrameProfiler& profiler, const char* fileName) {
+    FILE* file = fopen(fileName, "w");
+    if (!file) return false;
+    
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < profiler.trace.size(); i++) {
+        const TraceEvent& event = profiler.trace[i];
+        fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}%s\n",
+            event.phase == PHASE_COUNT ? "Frame" : phaseNames[event.phase],
+            event.start * 1000000.0, event.duration * 1000000.0, event.thread,
+            (i + 1 < profiler.trace.size()) ? "," : "");
+    }
+    fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+    return true;
+}
+
+// Legend lines of the overlay, placed when it draws
+struct ProfilerLabels {
+    int frame;                // Frame time, FPS and capture state
+    int phases[PHASE_COUNT];  // Average time per phase
+};
+
+void AddProfilerLabels(HudText& hud, ProfilerLabels& labels) {
+    labels.frame = AddHudLabel(hud, HUD_PROFILER, 0, 0, 10, WHITE, "");
+    for (int p = 0; p < PHASE_COUNT; p++) labels.phases[p] = AddHudLabel(hud, HUD_PROFILER, 0, 0, 10, WHITE, "");
+}
+
+// Last frame as a flame-style timeline, the rolling history as stacked columns.
+// Returns the draw calls issued by the legend.
+int DrawProfilerOverlay(const FrameProfiler& profiler, HudText& hud, const ProfilerLabels& labels, int x, int y, int width) {
+    const int barHeight = 16;
+    const int graphHeight = 80;
+    const float budgetMs = 1000.0f / 60.0f;
+    int last = (profiler.historyHead + PROFILE_HISTORY - 1) % PROFILE_HISTORY;
+    
+    DrawRectangle(x - 5, y - 5, width + 10, barHeight + graphHeight + 30 + PHASE_COUNT * 14, Fade(BLACK, 0.6f));
+    
+    // Timeline of the last frame, scaled to the 60 FPS budget
+    float msToPx = width / budgetMs;
+    DrawRectangleLines(x, y, width, barHeight, GRAY);
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        PhaseTiming timing = profiler.history[last][p];
+        if (timing.duration <= 0.0f) continue;
+        int px = x + (int)(timing.start * msToPx);
+        int pw = (int)(timing.duration * msToPx);
+        if (px >= x + width) continue;
+        DrawRectangle(px, y, (pw < 1) ? 1 : pw, barHeight, phaseColors[p]);
+    }
+    
+    // Rolling per-frame stacked phase times
+    int graphY = y + barHeight + 6;
+    float columnWidth = (float)width / PROFILE_HISTORY;
+    float msToGraph = graphHeight / (budgetMs * 2.0f);
+    DrawLine(x, graphY + graphHeight - (int)(budgetMs * msToGraph), x + width, 
+        graphY + graphHeight - (int)(budgetMs * msToGraph), Fade(WHITE, 0.5f));
+    for (int f = 0; f < PROFILE_HISTORY; f++) {
+        int slot = (profiler.historyHead + f) % PROFILE_HISTORY;
+        float stacked = 0.0f;
+        for (int p = 0; p < PHASE_COUNT; p++) {
+            float h = profiler.history[slot][p].duration * msToGraph;
+            if (h <= 0.0f) continue;
+            DrawRectangle(x + (int)(f * columnWidth), graphY + graphHeight - (int)(stacked + h), 
+                (int)columnWidth + 1, (int)h + 1, phaseColors[p]);
+            stacked += h;
+        }
+    }
+    
+    // Legend with averages over the history
+    // Values are compared at the precision shown, so a line is formatted and
+    // laid out again only when its text would change
+    int legendY = graphY + graphHeight + 6;
+    hud.labels[labels.frame].position = (Vector2){ (float)x, (float)legendY };
+    if (HudLabelValuesChanged(hud, labels.frame, roundf(profiler.frameMs[last] * 100.0f), (float)GetFPS(), (float)profiler.capturing)) {
+        SetHudLabelText(hud, labels.frame, TextFormat("Frame %.2f ms | %d FPS%s", profiler.frameMs[last], GetFPS(), 
+            profiler.capturing ? " | TRACE REC" : ""));
+    }
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        float total = 0.0f;
+        for (int f = 0; f < PROFILE_HISTORY; f++) total += profiler.history[f][p].duration;
+        float average = total / PROFILE_HISTORY;
+        DrawRectangle(x, legendY + 14 + p * 14, 10, 10, phaseColors[p]);
+        hud.labels[labels.phases[p]].position = (Vector2){ (float)(x + 16), (float)(legendY + 14 + p * 14) };
+        if (HudLabelValuesChanged(hud, labels.phases[p], roundf(average * 1000.0f))) {
+            SetHudLabelText(hud, labels.phases[p], TextFormat("%-10s %.3f ms", phaseNames[p], average));
+        }
+    }
+    return DrawHudText(hud, HUD_PROFILER);
+}
+
+// Per-frame statistics: counters restart every frame, gauges hold a level
+enum StatId {
+    STAT_PAIR_TESTS,
+    STAT_COLLISIONS,
+    STAT_DAMAGE_EVENTS,
+    STAT_REMOVALS,
+    STAT_COLLAPSED_BLOCKS,
+    STAT_DRAW_CALLS,
+    STAT_TEXT_LAYOUTS,
+    STAT_BLOCKS,
+    STAT_ACTIVE_BLOCKS,
+    STAT_SLEEPING_BLOCKS,
+    STAT_DESTROY_QUEUE,
+    STAT_DEBRIS,
+    STAT_HEAP_ALLOCS,
+    STAT_ARENA_BYTES,
+    STAT_COUNT
+};
+
+struct StatInfo {
+    const char* name;
+    bool isGauge;
+};
+
+const StatInfo statInfo[STAT_COUNT] = {
+    { "pair_tests", false },
+    { "collisions", false },
+    { "damage_events", false },
+    { "removals", false },
+    { "collapsed_blocks", false },
+    { "draw_calls", false },
+    { "text_layouts", false },
+    { "blocks", true },
+    { "active_blocks", true },
+    { "sleeping_blocks", true },
+    { "destroy_queue", true },
+    { "debris", true },
+    { "heap_allocs", true },
+    { "arena_bytes", true }
+};
+
+struct FrameStats {
+    long long values[STAT_COUNT];
+    long long frame;
+    size_t frameStartAllocations;
+    bool heapWarningShown;
+    FILE* csv;  // Open while telemetry recording is on
+};
+
+void InitFrameStats(FrameStats& stats) {
+    for (int i = 0; i < STAT_COUNT; i++) stats.values[i] = 0;
+    stats.frame = 0;
+    stats.frameStartAllocations = 0;
+    stats.heapWarningShown = false;
+    stats.csv = NULL;
+}
+
+void CountStat(FrameStats& stats, StatId id, long long amount = 1) {
+    stats.values[id] += amount;
+}
+
+void SetStat(FrameStats& stats, StatId id, long long value) {
+    stats.values[id] = value;
+}
+
+void BeginStatsFrame(FrameStats& stats) {
+    for (int i = 0; i < STAT_COUNT; i++) {
+        if (!statInfo[i].isGauge) stats.values[i] = 0;
+    }
+    stats.frameStartAllocations = GetHeapAllocationCount();
+}
+
+bool StartStatsCsv(FrameStats& stats, const char* fileName) {
+    stats.csv = fopen(fileName, "w");
+    if (!stats.csv) return false;
+    fprintf(stats.csv, "frame,time_s,frame_ms");
+    for (int i = 0; i < STAT_COUNT; i++) fprintf(stats.csv, ",%s", statInfo[i].name);
+    fprintf(stats.csv, "\n");
+    return true;
+}
+
+void StopStatsCsv(FrameStats& stats) {
+    if (stats.csv) fclose(stats.csv);
+    stats.csv = NULL;
+}
+
+// Appends this frame's row when recording
+void EndStatsFrame(FrameStats& stats, double time, float frameMs) {
+    if (stats.csv) {
+        fprintf(stats.csv, "%lld,%.4f,%.3f", stats.frame, time, frameMs);
+        for (int i = 0; i < STAT_COUNT; i++) fprintf(stats.csv, ",%lld", stats.values[i]);
+        fprintf(stats.csv, "\n");
+    }
+    stats.frame++;
+}
+
+// Panel lines, placed when it draws
+struct StatsLabels {
+    int title;
+    int values[STAT_COUNT];
+};
+
+void AddStatsLabels(HudText& hud, StatsLabels& labels) {
+    labels.title = AddHudLabel(hud, HUD_STATS, 0, 0, 10, WHITE, "");
+    for (int i = 0; i < STAT_COUNT; i++) labels.values[i] = AddHudLabel(hud, HUD_STATS, 0, 0, 10, WHITE, "");
+}
+
+// Returns the draw calls issued by the text
+int DrawFrameStats(const FrameStats& stats, HudText& hud, const StatsLabels& labels, int x, int y) {
+    DrawRectangle(x - 5, y - 5, 170, STAT_COUNT * 14 + 24, Fade(BLACK, 0.6f));
+    hud.labels[labels.title].position = (Vector2){ (float)x, (float)y };
+    SetHudLabelText(hud, labels.title, stats.csv ? "Stats (CSV REC)" : "Stats");
+    for (int i = 0; i < STAT_COUNT; i++) {
+        // Split so the float comparison stays exact for large counts
+        long long value = stats.values[i];
+        hud.labels[labels.values[i]].position = (Vector2){ (float)x, (float)(y + 14 + i * 14) };
+        if (HudLabelValuesChanged(hud, labels.values[i], (float)(value >> 24), (float)(value & 0xffffff))) {
+            SetHudLabelText(hud, labels.values[i], TextFormat("%-14s %lld", statInfo[i].name, value));
+        }
+    }
+    return DrawHudText(hud, HUD_STATS);
+}
+
+// Closes the frame for the profiler and the stats registry
+void EndFrameTelemetry(FrameProfiler& profiler, FrameStats& stats, const FrameArena& arena, size_t blockCount) {
+    EndProfileFrame(profiler);
+    SetStat(stats, STAT_BLOCKS, blockCount);
+    SetStat(stats, STAT_ARENA_BYTES, arena.peak);
+    
+    // Once warmed up, frames should not touch the heap (debug builds only)
+    size_t allocations = GetHeapAllocationCount() - stats.frameStartAllocations;
+    SetStat(stats, STAT_HEAP_ALLOCS, allocations);
+    if (allocations > 0 && stats.frame > 120 && !stats.heapWarningShown) {
+        TraceLog(LOG_WARNING, "ALLOC: Frame %lld made %d heap allocations", stats.frame, (int)allocations);
+        stats.heapWarningShown = true;
+    }
+
+    EndStatsFrame(stats, GetTime(), 
+        profiler.frameMs[(profiler.historyHead + PROFILE_HISTORY - 1) % PROFILE_HISTORY]);
+}
+
+// Spatial hash of block centres with one cell per block size.
+// Cells live in an open-addressed table (linear probing, power-of-two size);
+// each keeps an intrusive list of block indices threaded through `next`.
+struct GridCell {
+    long long key;  // -1 marks a free slot
+    int head;       // First block in the cell
+};
+
+struct BlockGrid {
+    float cellSize;
+    std::vector<GridCell> cells;
+    size_t cellCount;
+    std::vector<int> next;            // Per block: next block in the same cell, or -1
+    std::vector<long long> blockCell; // Per block: key of the cell it is listed in
+    unsigned int generation;          // Bumped whenever blocks are added, removed or renumbered
+};
+
+long long GetCellKey(int x, int y, int z) {
+    // 21 bits per axis, offset so negative cells pack cleanly
+    return ((long long)(x + (1 << 20)) << 42) | ((long long)(y + (1 << 20)) << 21) | (long long)(z + (1 << 20));
+}
+
+void GetCellKeyCoords(long long key, int coords[3]) {
+    coords[0] = (int)(key >> 42) - (1 << 20);
+    coords[1] = (int)((key >> 21) & 0x1fffff) - (1 << 20);
+    coords[2] = (int)(key & 0x1fffff) - (1 << 20);
+}
+
+int GetCellCoord(const BlockGrid& grid, float value) {
+    // Borders sit half a unit off the whole-unit lattice so snapped blocks
+    // never straddle one
+    return (int)floorf((value + 0.5f) / grid.cellSize);
+}
+
+long long GetCellKeyAt(const BlockGrid& grid, Vector3 position) {
+    return GetCellKey(GetCellCoord(grid, position.x), GetCellCoord(grid, position.y), GetCellCoord(grid, position.z));
+}
+
+// splitmix64 finalizer: every key bit reaches the low bits used as the slot
+unsigned long long HashCellKey(long long key) {
+    unsigned long long h = (unsigned long long)key;
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+    return h ^ (h >> 31);
+}
+
+size_t GetCellSlot(const BlockGrid& grid, long long key) {
+    return (size_t)HashCellKey(key) & (grid.cells.size() - 1);
+}
+
+// Returns the head of the cell's block list, or -1 if the cell is empty
+int FindCellHead(const BlockGrid& grid, long long key) {
+    if (grid.cells.empty()) return -1;
+    size_t mask = grid.cells.size() - 1;
+    for (size_t slot = GetCellSlot(grid, key); grid.cells[slot].key >= 0; slot = (slot + 1) & mask) {
+        if (grid.cells[slot].key == key) return grid.cells[slot].head;
+    }
+    return -1;
+}
+
+// Sizes the cell table for at least `cells` cells at under 50% load
+void ReserveCells(BlockGrid& grid, size_t cells) {
+    size_t capacity = grid.cells.empty() ? 64 : grid.cells.size();
+    while (capacity < cells * 2) capacity *= 2;
+    if (capacity == grid.cells.size()) return;
+    
+    std::vector<GridCell> oldCells(capacity, GridCell{ -1, -1 });
+    oldCells.swap(grid.cells);
+    size_t mask = capacity - 1;
+    for (const GridCell& cell : oldCells) {
+        if (cell.key < 0) continue;
+        size_t slot = GetCellSlot(grid, cell.key);
+        while (grid.cells[slot].key >= 0) slot = (slot + 1) & mask;
+        grid.cells[slot] = cell;
+    }
+}
+
+// Returns the cell's head slot, creating an empty cell if needed
+int& FindOrAddCell(BlockGrid& grid, long long key) {
+    ReserveCells(grid, grid.cellCount + 1);
+    size_t mask = grid.cells.size() - 1;
+    size_t slot = GetCellSlot(grid, key);
+    while (grid.cells[slot].key >= 0 && grid.cells[slot].key != key) slot = (slot + 1) & mask;
+    if (grid.cells[slot].key < 0) {
+        grid.cells[slot].key = key;
+        grid.cells[slot].head = -1;
+        grid.cellCount++;
+    }
+    return grid.cells[slot].head;
+}
+
+void EraseCell(BlockGrid& grid, long long key) {
+    size_t mask = grid.cells.size() - 1;
+    size_t slot = GetCellSlot(grid, key);
+    while (grid.cells[slot].key != key) slot = (slot + 1) & mask;
+    
+    // Backward-shift deletion keeps probe chains intact without tombstones
+    size_t hole = slot;
+    for (size_t i = (hole + 1) & mask; grid.cells[i].key >= 0; i = (i + 1) & mask) {
+        size_t home = GetCellSlot(grid, grid.cells[i].key);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            grid.cells[hole] = grid.cells[i];
+            hole = i;
+        }
+    }
+    grid.cells[hole].key = -1;
+    grid.cellCount--;
+}
+
+void GridInsert(BlockGrid& grid, int index, Vector3 position) {
+    if ((size_t)index >= grid.next.size()) {
+        grid.next.resize(index + 1, -1);
+        grid.blockCell.resize(index + 1, 0);
+    }
+    long long key = GetCellKeyAt(grid, position);
+    int& head = FindOrAddCell(grid, key);
+    grid.next[index] = head;
+    head = index;
+    grid.blockCell[index] = key;
+}
+
+void GridRemove(BlockGrid& grid, int index) {
+    long long key = grid.blockCell[index];
+    int* head = &FindOrAddCell(grid, key);
+    int* link = head;
+    while (*link != index) link = &grid.next[*link];
+    *link = grid.next[index];
+    if (*head < 0) EraseCell(grid, key);
+}
+
+// Relists block `from` under slot `to` after the block itself was moved there
+void GridMoveIndex(BlockGrid& grid, int from, int to) {
+    if ((size_t)to >= grid.next.size()) {
+        grid.next.resize(to + 1, -1);
+        grid.blockCell.resize(to + 1, 0);
+    }
+    int* link = &FindOrAddCell(grid, grid.blockCell[from]);
+    while (*link != from) link = &grid.next[*link];
+    *link = to;
+    grid.next[to] = grid.next[from];
+    grid.blockCell[to] = grid.blockCell[from];
+}
+
+// Keeps a moving block listed under the cell of its current position
+void GridUpdateBlock(BlockGrid& grid, int index, Vector3 position) {
+    if (GetCellKeyAt(grid, position) != grid.blockCell[index]) {
+        GridRemove(grid, index);
+        GridInsert(grid, index, position);
+    }
+}
+
+template <typename T>
+void RebuildBlockGrid(BlockGrid& grid, const std::vector<T>& blocks) {
+    grid.generation++;
+    grid.cells.assign(grid.cells.size(), GridCell{ -1, -1 });
+    grid.cellCount = 0;
+    ReserveCells(grid, blocks.size());
+    grid.next.assign(blocks.size(), -1);
+    grid.blockCell.assign(blocks.size(), 0);
+    for (size_t i = 0; i < blocks.size(); i++) {
+        GridInsert(grid, (int)i, GetBlockCenter(blocks[i]));
+    }
+}
+
+// Visits every block whose centre cell touches the box [min, max]
+template <typename Visitor>
+void ForEachBlockInCells(const BlockGrid& grid, Vector3 min, Vector3 max, Visitor visit) {
+    int x0 = GetCellCoord(grid, min.x), x1 = GetCellCoord(grid, max.x);
+    int y0 = GetCellCoord(grid, min.y), y1 = GetCellCoord(grid, max.y);
+    int z0 = GetCellCoord(grid, min.z), z1 = GetCellCoord(grid, max.z);
+    for (int x = x0; x <= x1; x++) {
+        for (int y = y0; y <= y1; y++) {
+            for (int z = z0; z <= z1; z++) {
+                for (int i = FindCellHead(grid, GetCellKey(x, y, z)); i >= 0; i = grid.next[i]) {
+                    visit(i);
+                }
+            }
+        }
+    }
+}
+
+// Returns the index of the block snapped at position, or -1
+template <typename T>
+int FindBlockAt(const std::vector<T>& blocks, const BlockGrid& grid, Vector3 position) {
+    int found = -1;
+    Vector3 tolerance = { 0.1f, 0.1f, 0.1f };
+    ForEachBlockInCells(grid, Vector3Subtract(position, tolerance), Vector3Add(position, tolerance), 
+        [&](int i) {
+            if (found < 0 && Vector3Distance(GetBlockCenter(blocks[i]), position) < 0.1f) found = i;
+        });
+    return found;
+}
+
+struct BlockHit {
+    int index;        // Dynamic block index, -1 when nothing was hit (0 for static blocks)
+    float distance;
+    Vector3 point;
+    Vector3 normal;   // Normal of the face that was hit
+    Vector3 center;   // Centre of the block that was hit
+    bool isStatic;
+};
+
+// 3D-DDA through the grid cells along the ray. A block can reach one cell past
+// the cell holding its centre, so entering a cell tests the newly exposed
+// 3x3 slab of neighbours. Cost scales with cells crossed, not block count.
+template <typename T>
+BlockHit RaycastBlocks(const std::vector<T>& blocks, const BlockGrid& grid, Ray ray, 
+                       float maxDistance, Vector3 blockSize) {
+    BlockHit hit = { -1, maxDistance, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, false };
+    
+    auto testCell = [&](int x, int y, int z) {
+        for (int i = FindCellHead(grid, GetCellKey(x, y, z)); i >= 0; i = grid.next[i]) {
+            RayCollision collision = GetRayCollisionBox(ray, GetBlockBoundingBox(blocks[i], blockSize));
+            // Negative distance means the ray starts inside the block
+            if (collision.hit && collision.distance >= 0.0f && collision.distance < hit.distance) {
+                hit.index = i;
+                hit.distance = collision.distance;
+                hit.point = collision.point;
+                hit.normal = collision.normal;
+                hit.center = GetBlockCenter(blocks[i]);
+            }
+        }
+    };
+    
+    float origin[3] = { ray.position.x, ray.position.y, ray.position.z };
+    float dir[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+    int cell[3], step[3];
+    float tMax[3], tDelta[3];
+    for (int a = 0; a < 3; a++) {
+        cell[a] = GetCellCoord(grid, origin[a]);
+        step[a] = (dir[a] > 0.0f) ? 1 : (dir[a] < 0.0f ? -1 : 0);
+        if (step[a] != 0) {
+            float border = (cell[a] + (step[a] > 0 ? 1 : 0)) * grid.cellSize - 0.5f;
+            tMax[a] = (border - origin[a]) / dir[a];
+            tDelta[a] = grid.cellSize / fabsf(dir[a]);
+        } else {
+            tMax[a] = tDelta[a] = INFINITY;
+        }
+    }
+    
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dz = -1; dz <= 1; dz++) {
+                testCell(cell[0] + dx, cell[1] + dy, cell[2] + dz);
+            }
+        }
+    }
+    
+    while (true) {
+        int a = (tMax[0] < tMax[1]) ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+        // Every block the ray could hit before leaving this cell is already tested
+        if (tMax[a] >= hit.distance) break;
+        
+        cell[a] += step[a];
+        tMax[a] += tDelta[a];
+        
+        int u = (a + 1) % 3, v = (a + 2) % 3;
+        int probe[3];
+        probe[a] = cell[a] + step[a];
+        for (int du = -1; du <= 1; du++) {
+            for (int dv = -1; dv <= 1; dv++) {
+                probe[u] = cell[u] + du;
+                probe[v] = cell[v] + dv;
+                testCell(probe[0], probe[1], probe[2]);
+            }
+        }
+    }
+    return hit;
+}
+
+// Snapped slot where the ray crosses the floor of the layer centred at layerY
+Vector3 GetLayerPoint(Ray ray, float layerY, Vector3 blockSize) {
+    float floorY = layerY - blockSize.y/2;
+    float t = (ray.direction.y != 0.0f) ? (floorY - ray.position.y) / ray.direction.y : 0.0f;
+    if (t < 0.0f) t = 0.0f;
+    return (Vector3){
+        roundf(ray.position.x + ray.direction.x * t),
+        layerY,
+        roundf(ray.position.z + ray.direction.z * t)
+    };
+}
+
+template <typename T>
+void AddBlock(std::vector<T>& blocks, BlockGrid& grid, const T& block) {
+    grid.generation++;
+    blocks.push_back(block);
+    GridInsert(grid, (int)blocks.size() - 1, GetBlockCenter(block));
+}
+
+// O(1) removal: the last block is moved into the freed slot
+template <typename T>
+void RemoveBlock(std::vector<T>& blocks, BlockGrid& grid, size_t index) {
+    size_t last = blocks.size() - 1;
+    grid.generation++;
+    GridRemove(grid, (int)index);
+    if (index != last) {
+        blocks[index] = blocks[last];
+        GridMoveIndex(grid, (int)last, (int)index);
+    }
+    blocks.pop_back();
+    grid.next.pop_back();
+    grid.blockCell.pop_back();
+}
+
+// Reverses RemoveBlock: the block swapped into index moves back to the end
+template <typename T>
+void RestoreBlock(std::vector<T>& blocks, BlockGrid& grid, size_t index, const T& block) {
+    if (index == blocks.size()) {
+        AddBlock(blocks, grid, block);
+        return;
+    }
+    grid.generation++;
+    blocks.push_back(blocks[index]);
+    GridMoveIndex(grid, (int)index, (int)blocks.size() - 1);
+    blocks[index] = block;
+    GridInsert(grid, (int)index, GetBlockCenter(block));
+}
+
+void ToggleBlockStatic(Block& block) {
+    block.isStatic = !block.isStatic;
+    if (block.isStatic) {
+        block.maxHealth = block.health = 1000.0f;
+    } else {
+        block.maxHealth = block.health = 100.0f;
+    }
+}
+
+// Static world: a brick map over block-size voxels (2 units, 4 half units).
+// A voxel holds the static block centred in it: the centre's half-unit offset
+// inside the voxel and its palette colour. Bricks group 4x4x4 voxels and are
+// merged into a single value while all of them match, so uniform regions cost
+// one table entry. Regions of 8x8x8 bricks are the unit of streaming.
+#define VOXEL_HALF_UNITS 4
+#define BRICK_SIZE 4
+#define BRICK_VOXELS (BRICK_SIZE * BRICK_SIZE * BRICK_SIZE)
+#define REGION_BRICKS 8
+
+typedef unsigned short Voxel;  // 0 when empty, else 0x8000 | offset << 8 | palette
+
+struct Brick {
+    long long key;          // Packed brick coordinates, -1 for a free slot
+    int voxels;             // Start of the brick's voxels in StaticWorld::voxels, -1 while merged
+    Voxel uniform;          // Value of every voxel while merged
+    unsigned short count;   // Occupied voxels
+};
+
+struct StaticWorld {
+    std::vector<Brick> bricks;     // Open-addressed by key, power-of-two size
+    size_t brickCount;
+    std::vector<Voxel> voxels;     // Voxels of unmerged bricks, BRICK_VOXELS each
+    std::vector<int> freeVoxels;   // Released voxel ranges
+    std::vector<Color> palette;    // Up to 256 colours
+    size_t blockCount;
+    unsigned int revision;         // Bumped on every change, for caches of static geometry
+    size_t streamedCount;          // Blocks in streamed-out regions
+    unsigned long long streamedSum;  // Their HashStaticBlock sum, so checksums cover them
+};
+
+void InitStaticWorld(StaticWorld& world) {
+    world.bricks.assign(64, Brick{ -1, -1, 0, 0 });
+    world.brickCount = 0;
+    world.voxels.clear();
+    world.freeVoxels.clear();
+    world.palette.clear();
+    world.blockCount = 0;
+    world.revision = 0;
+    world.streamedCount = 0;
+    world.streamedSum = 0;
+}
+
+int FloorDiv(int value, int divisor) {
+    return (value >= 0) ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+size_t GetBrickSlot(const StaticWorld& world, long long key) {
+    return (size_t)HashCellKey(key) & (world.bricks.size() - 1);
+}
+
+const Brick* FindBrick(const StaticWorld& world, long long key) {
+    size_t mask = world.bricks.size() - 1;
+    for (size_t slot = GetBrickSlot(world, key); world.bricks[slot].key >= 0; slot = (slot + 1) & mask) {
+        if (world.bricks[slot].key == key) return &world.bricks[slot];
+    }
+    return NULL;
+}
+
+Brick& FindOrAddBrick(StaticWorld& world, long long key) {
+    // Keep the table under 50% load
+    if ((world.brickCount + 1) * 2 > world.bricks.size()) {
+        std::vector<Brick> oldBricks(world.bricks.size() * 2, Brick{ -1, -1, 0, 0 });
+        oldBricks.swap(world.bricks);
+        size_t mask = world.bricks.size() - 1;
+        for (const Brick& brick : oldBricks) {
+            if (brick.key < 0) continue;
+            size_t slot = GetBrickSlot(world, brick.key);
+            while (world.bricks[slot].key >= 0) slot = (slot + 1) & mask;
+            world.bricks[slot] = brick;
+        }
+    }
+    size_t mask = world.bricks.size() - 1;
+    size_t slot = GetBrickSlot(world, key);
+    while (world.bricks[slot].key >= 0 && world.bricks[slot].key != key) slot = (slot + 1) & mask;
+    if (world.bricks[slot].key < 0) {
+        world.bricks[slot] = Brick{ key, -1, 0, 0 };
+        world.brickCount++;
+    }
+    return world.bricks[slot];
+}
+
+void EraseBrick(StaticWorld& world, long long key) {
+    size_t mask = world.bricks.size() - 1;
+    size_t slot = GetBrickSlot(world, key);
+    while (world.bricks[slot].key != key) slot = (slot + 1) & mask;
+    if (world.bricks[slot].voxels >= 0) world.freeVoxels.push_back(world.bricks[slot].voxels);
+    world.blockCount -= world.bricks[slot].count;
+    world.revision++;
+    
+    // Same backward-shift deletion as the grid cell table
+    size_t hole = slot;
+    for (size_t i = (hole + 1) & mask; world.bricks[i].key >= 0; i = (i + 1) & mask) {
+        size_t home = GetBrickSlot(world, world.bricks[i].key);
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            world.bricks[hole] = world.bricks[i];
+            hole = i;
+        }
+    }
+    world.bricks[hole].key = -1;
+    world.brickCount--;
+}
+
+Voxel GetBrickVoxel(const StaticWorld& world, const Brick& brick, int local) {
+    return (brick.voxels < 0) ? brick.uniform : world.voxels[brick.voxels + local];
+}
+
+Voxel GetVoxel(const StaticWorld& world, int x, int y, int z) {
+    int bx = FloorDiv(x, BRICK_SIZE), by = FloorDiv(y, BRICK_SIZE), bz = FloorDiv(z, BRICK_SIZE);
+    const Brick* brick = FindBrick(world, GetCellKey(bx, by, bz));
+    if (!brick) return 0;
+    int local = ((x - bx * BRICK_SIZE) * BRICK_SIZE + (y - by * BRICK_SIZE)) * BRICK_SIZE + (z - bz * BRICK_SIZE);
+    return GetBrickVoxel(world, *brick, local);
+}
+
+// Writes one voxel, splitting a merged brick or merging a brick that became uniform
+void SetVoxel(StaticWorld& world, int x, int y, int z, Voxel value) {
+    int bx = FloorDiv(x, BRICK_SIZE), by = FloorDiv(y, BRICK_SIZE), bz = FloorDiv(z, BRICK_SIZE);
+    long long key = GetCellKey(bx, by, bz);
+    if (value == 0 && !FindBrick(world, key)) return;
+    
+    Brick& brick = FindOrAddBrick(world, key);
+    int local = ((x - bx * BRICK_SIZE) * BRICK_SIZE + (y - by * BRICK_SIZE)) * BRICK_SIZE + (z - bz * BRICK_SIZE);
+    Voxel old = GetBrickVoxel(world, brick, local);
+    if (old == value) return;
+    world.revision++;
+    
+    if (brick.voxels < 0) {
+        if (!world.freeVoxels.empty()) {
+            brick.voxels = world.freeVoxels.back();
+            world.freeVoxels.pop_back();
+        } else {
+            brick.voxels = (int)world.voxels.size();
+            world.voxels.resize(world.voxels.size() + BRICK_VOXELS);
+        }
+        std::fill(world.voxels.begin() + brick.voxels, world.voxels.begin() + brick.voxels + BRICK_VOXELS, brick.uniform);
+    }
+    world.voxels[brick.voxels + local] = value;
+    int change = (value != 0) - (old != 0);
+    brick.count += change;
+    world.blockCount += change;
+    
+    if (brick.count == 0) {
+        EraseBrick(world, key);
+        return;
+    }
+    const Voxel* voxels = &world.voxels[brick.voxels];
+    for (int i = 1; i < BRICK_VOXELS; i++) {
+        if (voxels[i] != voxels[0]) return;
+    }
+    brick.uniform = voxels[0];
+    world.freeVoxels.push_back(brick.voxels);
+    brick.voxels = -1;
+}
+
+void GetStaticVoxelCoords(const StaticBlock& block, int voxel[3], int offset[3]) {
+    const short coords[3] = { block.x, block.y, block.z };
+    for (int a = 0; a < 3; a++) {
+        voxel[a] = FloorDiv(coords[a], VOXEL_HALF_UNITS);
+        offset[a] = coords[a] - voxel[a] * VOXEL_HALF_UNITS;
+    }
+}
+
+StaticBlock DecodeVoxel(Voxel value, int x, int y, int z) {
+    int offset = (value >> 8) & 0x3f;
+    return (StaticBlock){
+        (short)(x * VOXEL_HALF_UNITS + (offset & 3)),
+        (short)(y * VOXEL_HALF_UNITS + ((offset >> 2) & 3)),
+        (short)(z * VOXEL_HALF_UNITS + (offset >> 4)),
+        (unsigned char)(value & 0xff)
+    };
+}
+
+// Fails if another static block is centred in the same voxel
+bool AddStaticBlock(StaticWorld& world, StaticBlock block) {
+    int voxel[3], offset[3];
+    GetStaticVoxelCoords(block, voxel, offset);
+    if (GetVoxel(world, voxel[0], voxel[1], voxel[2]) != 0) return false;
+    Voxel value = (Voxel)(0x8000 | (offset[0] | offset[1] << 2 | offset[2] << 4) << 8 | block.palette);
+    SetVoxel(world, voxel[0], voxel[1], voxel[2], value);
+    return true;
+}
+
+// Finds the static block centred exactly at position
+bool FindStaticBlock(const StaticWorld& world, Vector3 position, StaticBlock* found) {
+    StaticBlock probe = { (short)roundf(position.x * 2.0f), (short)roundf(position.y * 2.0f), (short)roundf(position.z * 2.0f), 0 };
+    int voxel[3], offset[3];
+    GetStaticVoxelCoords(probe, voxel, offset);
+    Voxel value = GetVoxel(world, voxel[0], voxel[1], voxel[2]);
+    if (value == 0 || ((value >> 8) & 0x3f) != (offset[0] | offset[1] << 2 | offset[2] << 4)) return false;
+    if (found) *found = DecodeVoxel(value, voxel[0], voxel[1], voxel[2]);
+    return true;
+}
+
+bool RemoveStaticBlock(StaticWorld& world, Vector3 position) {
+    StaticBlock block;
+    if (!FindStaticBlock(world, position, &block)) return false;
+    int voxel[3], offset[3];
+    GetStaticVoxelCoords(block, voxel, offset);
+    SetVoxel(world, voxel[0], voxel[1], voxel[2], 0);
+    return true;
+}
+
+template <typename Visitor>
+void ForEachBrickBlock(const StaticWorld& world, const Brick& brick, Visitor visit) {
+    int b[3];
+    GetCellKeyCoords(brick.key, b);
+    for (int local = 0; local < BRICK_VOXELS; local++) {
+        Voxel value = GetBrickVoxel(world, brick, local);
+        if (value == 0) continue;
+        visit(DecodeVoxel(value, b[0] * BRICK_SIZE + local / (BRICK_SIZE * BRICK_SIZE),
+                          b[1] * BRICK_SIZE + (local / BRICK_SIZE) % BRICK_SIZE, b[2] * BRICK_SIZE + local % BRICK_SIZE));
+    }
+}
+
+// Visits every static block, a brick at a time
+template <typename Visitor>
+void ForEachStaticBlock(const StaticWorld& world, Visitor visit) {
+    for (const Brick& brick : world.bricks) {
+        if (brick.key >= 0) ForEachBrickBlock(world, brick, visit);
+    }
+}
+
+// Order-independent per-block term of the world hash
+unsigned long long HashStaticBlock(const StaticBlock& block) {
+    return HashCellKey(((long long)(unsigned short)block.x << 40) | ((long long)(unsigned short)block.y << 24) | 
+                       ((long long)(unsigned short)block.z << 8) | block.palette);
+}
+
+// Visits every static block whose box touches [min, max] (block size 2).
+// Centres can sit up to 1.5 units inside a voxel, so the voxel range is
+// padded by one on each side; empty bricks are skipped whole.
+template <typename Visitor>
+void ForEachStaticBlockInBox(const StaticWorld& world, Vector3 min, Vector3 max, Visitor visit) {
+    float lo[3] = { min.x - 1.0f, min.y - 1.0f, min.z - 1.0f };
+    float hi[3] = { max.x + 1.0f, max.y + 1.0f, max.z + 1.0f };
+    int v0[3], v1[3];
+    for (int a = 0; a < 3; a++) {
+        v0[a] = (int)floorf(lo[a] * 2.0f / VOXEL_HALF_UNITS);
+        v1[a] = (int)floorf(hi[a] * 2.0f / VOXEL_HALF_UNITS);
+    }
+    for (int bx = FloorDiv(v0[0], BRICK_SIZE); bx <= FloorDiv(v1[0], BRICK_SIZE); bx++) {
+        for (int by = FloorDiv(v0[1], BRICK_SIZE); by <= FloorDiv(v1[1], BRICK_SIZE); by++) {
+            for (int bz = FloorDiv(v0[2], BRICK_SIZE); bz <= FloorDiv(v1[2], BRICK_SIZE); bz++) {
+                const Brick* brick = FindBrick(world, GetCellKey(bx, by, bz));
+                if (!brick) continue;
+                
+                int x0 = std::max(v0[0], bx * BRICK_SIZE), x1 = std::min(v1[0], bx * BRICK_SIZE + BRICK_SIZE - 1);
+                int y0 = std::max(v0[1], by * BRICK_SIZE), y1 = std::min(v1[1], by * BRICK_SIZE + BRICK_SIZE - 1);
+                int z0 = std::max(v0[2], bz * BRICK_SIZE), z1 = std::min(v1[2], bz * BRICK_SIZE + BRICK_SIZE - 1);
+                for (int x = x0; x <= x1; x++) {
+                    for (int y = y0; y <= y1; y++) {
+                        for (int z = z0; z <= z1; z++) {
+                            int local = ((x - bx * BRICK_SIZE) * BRICK_SIZE + (y - by * BRICK_SIZE)) * BRICK_SIZE + (z - bz * BRICK_SIZE);
+                            Voxel value = GetBrickVoxel(world, *brick, local);
+                            if (value == 0) continue;
+                            StaticBlock block = DecodeVoxel(value, x, y, z);
+                            Vector3 c = GetBlockCenter(block);
+                            if (c.x >= lo[0] && c.x <= hi[0] && c.y >= lo[1] && c.y <= hi[1] && c.z >= lo[2] && c.z <= hi[2]) {
+                                visit(block);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Point occupancy: true if position lies strictly inside a static block
+bool IsPointInStaticBlock(const StaticWorld& world, Vector3 position) {
+    bool inside = false;
+    ForEachStaticBlockInBox(world, position, position, [&](const StaticBlock& block) {
+        Vector3 d = Vector3Subtract(GetBlockCenter(block), position);
+        if (fabsf(d.x) < 1.0f && fabsf(d.y) < 1.0f && fabsf(d.z) < 1.0f) inside = true;
+    });
+    return inside;
+}
+
+// Same voxel DDA as RaycastBlocks. A block reaches at most one voxel past its
+// own, so entering a voxel tests the newly exposed 3x3 slab.
+BlockHit RaycastStatic(const StaticWorld& world, Ray ray, float maxDistance, Vector3 blockSize) {
+    BlockHit hit = { -1, maxDistance, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, true };
+    float voxelSize = VOXEL_HALF_UNITS * 0.5f;
+    
+    auto testVoxel = [&](int x, int y, int z) {
+        Voxel value = GetVoxel(world, x, y, z);
+        if (value == 0) return;
+        StaticBlock block = DecodeVoxel(value, x, y, z);
+        RayCollision collision = GetRayCollisionBox(ray, GetBlockBoundingBox(block, blockSize));
+        if (collision.hit && collision.distance >= 0.0f && collision.distance < hit.distance) {
+            hit.index = 0;
+            hit.distance = collision.distance;
+            hit.point = collision.point;
+            hit.normal = collision.normal;
+            hit.center = GetBlockCenter(block);
+        }
+    };
+    
+    float origin[3] = { ray.position.x, ray.position.y, ray.position.z };
+    float dir[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+    int voxel[3], step[3];
+    float tMax[3], tDelta[3];
+    for (int a = 0; a < 3; a++) {
+        voxel[a] = (int)floorf(origin[a] / voxelSize);
+        step[a] = (dir[a] > 0.0f) ? 1 : (dir[a] < 0.0f ? -1 : 0);
+        if (step[a] != 0) {
+            float border = (voxel[a] + (step[a] > 0 ? 1 : 0)) * voxelSize;
+            tMax[a] = (border - origin[a]) / dir[a];
+            tDelta[a] = voxelSize / fabsf(dir[a]);
+        } else {
+            tMax[a] = tDelta[a] = INFINITY;
+        }
+    }
+    
+    for (int dx = -1; dx <= 1; dx++) {
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dz = -1; dz <= 1; dz++) {
+                testVoxel(voxel[0] + dx, voxel[1] + dy, voxel[2] + dz);
+            }
+        }
+    }
+    
+    while (true) {
+        int a = (tMax[0] < tMax[1]) ? (tMax[0] < tMax[2] ? 0 : 2) : (tMax[1] < tMax[2] ? 1 : 2);
+        if (tMax[a] >= hit.distance) break;
+        
+        voxel[a] += step[a];
+        tMax[a] += tDelta[a];
+        
+        int u = (a + 1) % 3, v = (a + 2) % 3;
+        int probe[3];
+        probe[a] = voxel[a] + step[a];
+        for (int du = -1; du <= 1; du++) {
+            for (int dv = -1; dv <= 1; dv++) {
+                probe[u] = voxel[u] + du;
+                probe[v] = voxel[v] + dv;
+                testVoxel(probe[0], probe[1], probe[2]);
+            }
+        }
+    }
+    return hit;
+}
+
+// Visits the static blocks in bricks that are within range and not behind the camera
+template <typename Visitor>
+void ForEachVisibleStaticBlock(const StaticWorld& world, Camera3D camera, float drawDistance, Visitor visit) {
+    Vector3 forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+    float brickExtent = BRICK_SIZE * VOXEL_HALF_UNITS * 0.5f;
+    float brickRadius = brickExtent * 0.87f + 1.0f;
+    for (const Brick& brick : world.bricks) {
+        if (brick.key < 0) continue;
+        int b[3];
+        GetCellKeyCoords(brick.key, b);
+        Vector3 center = { (b[0] + 0.5f) * brickExtent, (b[1] + 0.5f) * brickExtent, (b[2] + 0.5f) * brickExtent };
+        Vector3 toBrick = Vector3Subtract(center, camera.position);
+        if (Vector3Length(toBrick) > drawDistance + brickRadius) continue;
+        if (Vector3DotProduct(toBrick, forward) < -brickRadius) continue;
+        
+        for (int local = 0; local < BRICK_VOXELS; local++) {
+            Voxel value = GetBrickVoxel(world, brick, local);
+            if (value == 0) continue;
+            visit(DecodeVoxel(value, b[0] * BRICK_SIZE + local / (BRICK_SIZE * BRICK_SIZE),
+                b[1] * BRICK_SIZE + (local / BRICK_SIZE) % BRICK_SIZE, b[2] * BRICK_SIZE + local % BRICK_SIZE));
+        }
+    }
+}
+
+// Streaming: regions far from the focus are written to disk and dropped from
+// memory, then read back once the focus comes near again. Region files only
+// live for the session (palette indices refer to the in-memory palette).
+struct StaticStreamer {
+    const char* directory;          // NULL disables streaming
+    float radius;                   // Regions whose centre is farther away get streamed out
+    std::vector<long long> stored;  // Regions currently on disk
+    unsigned int steps;             // Simulation steps seen, paces the update
+    std::vector<std::pair<long long, long long>> outgoing;  // (region, brick) scratch, kept between updates
+};
+
+long long GetRegionKey(long long brickKey) {
+    int b[3];
+    GetCellKeyCoords(brickKey, b);
+    return GetCellKey(FloorDiv(b[0], REGION_BRICKS), FloorDiv(b[1], REGION_BRICKS), FloorDiv(b[2], REGION_BRICKS));
+}
+
+Vector3 GetRegionCenter(long long regionKey) {
+    int r[3];
+    GetCellKeyCoords(regionKey, r);
+    float extent = REGION_BRICKS * BRICK_SIZE * VOXEL_HALF_UNITS * 0.5f;
+    return (Vector3){ (r[0] + 0.5f) * extent, (r[1] + 0.5f) * extent, (r[2] + 0.5f) * extent };
+}
+
+// Formats into the caller's buffer: streaming runs on the simulation thread,
+// where TextFormat's shared buffers would race with the HUD
+void GetRegionFileName(const StaticStreamer& streamer, long long regionKey, char* fileName, size_t size) {
+    snprintf(fileName, size, "%s/region_%llx.bin", streamer.directory, (unsigned long long)regionKey);
+}
+
+// Writes the given bricks (all of one region) and removes them from the world
+bool StreamOutStaticRegion(StaticWorld& world, const std::pair<long long, long long>* bricks, size_t count, const char* fileName) {
+    FILE* file = fopen(fileName, "wb");
+    if (!file) {
+        TraceLog(LOG_WARNING, "STREAM: Failed to write region [%s]", fileName);
+        return false;
+    }
+    fwrite("SREG", 1, 4, file);
+    fwrite(&count, sizeof(count), 1, file);
+    for (size_t i = 0; i < count; i++) {
+        const Brick& brick = *FindBrick(world, bricks[i].second);
+        bool merged = brick.voxels < 0;
+        fwrite(&brick.key, sizeof(brick.key), 1, file);
+        fwrite(&brick.uniform, sizeof(brick.uniform), 1, file);
+        fwrite(&brick.count, sizeof(brick.count), 1, file);
+        fwrite(&merged, sizeof(merged), 1, file);
+        if (!merged) fwrite(&world.voxels[brick.voxels], sizeof(Voxel), BRICK_VOXELS, file);
+    }
+    fclose(file);
+    
+    for (size_t i = 0; i < count; i++) {
+        const Brick& brick = *FindBrick(world, bricks[i].second);
+        ForEachBrickBlock(world, brick, [&](const StaticBlock& block) {
+            world.streamedSum += HashStaticBlock(block);
+        });
+        world.streamedCount += brick.count;
+        EraseBrick(world, bricks[i].second);
+    }
+    return true;
+}
+
+bool StreamInStaticRegion(StaticWorld& world, const char* fileName) {
+    FILE* file = fopen(fileName, "rb");
+    if (!file) return false;
+    char magic[4];
+    size_t count = 0;
+    bool valid = fread(magic, 1, 4, file) == 4 && memcmp(magic, "SREG", 4) == 0 && 
+                 fread(&count, sizeof(count), 1, file) == 1;
+    for (size_t i = 0; valid && i < count; i++) {
+        Brick loaded = { -1, -1, 0, 0 };
+        bool merged = true;
+        valid = fread(&loaded.key, sizeof(loaded.key), 1, file) == 1 &&
+                fread(&loaded.uniform, sizeof(loaded.uniform), 1, file) == 1 &&
+                fread(&loaded.count, sizeof(loaded.count), 1, file) == 1 &&
+                fread(&merged, sizeof(merged), 1, file) == 1;
+        if (!valid) break;
+        
+        Brick& brick = FindOrAddBrick(world, loaded.key);
+        world.revision++;
+        brick.uniform = loaded.uniform;
+        brick.count = loaded.count;
+        world.blockCount += loaded.count;
+        if (!merged) {
+            if (!world.freeVoxels.empty()) {
+                brick.voxels = world.freeVoxels.back();
+                world.freeVoxels.pop_back();
+            } else {
+                brick.voxels = (int)world.voxels.size();
+                world.voxels.resize(world.voxels.size() + BRICK_VOXELS);
+            }
+            valid = fread(&world.voxels[brick.voxels], sizeof(Voxel), BRICK_VOXELS, file) == BRICK_VOXELS;
+        }
+        ForEachBrickBlock(world, brick, [&](const StaticBlock& block) {
+            world.streamedSum -= HashStaticBlock(block);
+        });
+        world.streamedCount -= brick.count;
+    }
+    fclose(file);
+    if (!valid) TraceLog(LOG_WARNING, "STREAM: Region file [%s] is truncated", fileName);
+    return valid;
+}
+
+// Streams regions out beyond the radius and back in within 3/4 of it
+void UpdateStaticStreaming(StaticWorld& world, StaticStreamer& streamer, Vector3 focus) {
+    if (!streamer.directory) return;
+    
+    for (size_t i = 0; i < streamer.stored.size(); ) {
+        long long region = streamer.stored[i];
+        if (Vector3Distance(GetRegionCenter(region), focus) < streamer.radius * 0.75f) {
+            char fileName[512];
+            GetRegionFileName(streamer, region, fileName, sizeof(fileName));
+            StreamInStaticRegion(world, fileName);
+            remove(fileName);
+            streamer.stored[i] = streamer.stored.back();
+            streamer.stored.pop_back();
+        } else {
+            i++;
+        }
+    }
+    
+    // One pass buckets the far bricks by region, so each region is written
+    // from its own run instead of rescanning the whole brick table
+    std::vector<std::pair<long long, long long>>& outgoing = streamer.outgoing;
+    outgoing.clear();
+    for (const Brick& brick : world.bricks) {
+        if (brick.key < 0) continue;
+        long long region = GetRegionKey(brick.key);
+        if (Vector3Distance(GetRegionCenter(region), focus) > streamer.radius) {
+            outgoing.push_back(std::make_pair(region, brick.key));
+        }
+    }
+    std::sort(outgoing.begin(), outgoing.end());
+    for (size_t begin = 0, end = 0; begin < outgoing.size(); begin = end) {
+        long long region = outgoing[begin].first;
+        while (end < outgoing.size() && outgoing[end].first == region) end++;
+        char fileName[512];
+        GetRegionFileName(streamer, region, fileName, sizeof(fileName));
+        if (StreamOutStaticRegion(world, &outgoing[begin], end - begin, fileName)) {
+            streamer.stored.push_back(region);
+        }
+    }
+}
+
+// Brings every streamed-out region back, e.g. before editing
+void StreamInAllStaticRegions(StaticWorld& world, StaticStreamer& streamer) {
+    for (long long region : streamer.stored) {
+        char fileName[512];
+        GetRegionFileName(streamer, region, fileName, sizeof(fileName));
+        StreamInStaticRegion(world, fileName);
+        remove(fileName);
+    }
+    streamer.stored.clear();
+}
+
+unsigned char GetPaletteIndex(std::vector<Color>& palette, Color color) {
+    for (size_t i = 0; i < palette.size(); i++) {
+        Color c = palette[i];
+        if (c.r == color.r && c.g == color.g && c.b == color.b && c.a == color.a) return (unsigned char)i;
+    }
+    if (palette.size() < 256) {
+        palette.push_back(color);
+        return (unsigned char)(palette.size() - 1);
+    }
+    
+    // Palette full: fall back to the closest colour
+    int best = 0, bestDistance = 0x7fffffff;
+    for (size_t i = 0; i < palette.size(); i++) {
+        int dr = palette[i].r - color.r, dg = palette[i].g - color.g, db = palette[i].b - color.b;
+        int distance = dr*dr + dg*dg + db*db;
+        if (distance < bestDistance) {
+            best = (int)i;
+            bestDistance = distance;
+        }
+    }
+    return (unsigned char)best;
+}
+
+StaticBlock PackStaticBlock(StaticWorld& world, const Block& block) {
+    return (StaticBlock){
+        (short)roundf(block.position.x * 2.0f),
+        (short)roundf(block.position.y * 2.0f),
+        (short)roundf(block.position.z * 2.0f),
+        GetPaletteIndex(world.palette, block.color)
+    };
+}
+
+Block UnpackStaticBlock(const StaticWorld& world, const StaticBlock& block) {
+    return (Block){ GetBlockCenter(block), { 0.0f, 0.0f, 0.0f }, world.palette[block.palette], true, 1000.0f, 1000.0f };
+}
+
+// Nearest block along the ray, dynamic or static
+BlockHit RaycastWorld(const std::vector<Block>& blocks, const BlockGrid& grid, const StaticWorld& world, 
+                      Ray ray, float maxDistance, Vector3 blockSize) {
+    BlockHit hit = RaycastStatic(world, ray, maxDistance, blockSize);
+    BlockHit dynamicHit = RaycastBlocks(blocks, grid, ray, hit.distance, blockSize);
+    return dynamicHit.index >= 0 ? dynamicHit : hit;
+}
+
+// Moves a block to the other store, appending dynamic blocks. `block` is its
+// current state; static blocks are found by position, dynamic ones by index.
+// Fails if a static block already sits in the target voxel.
+bool ToggleStoredBlock(std::vector<Block>& blocks, BlockGrid& grid, StaticWorld& world, int index, const Block& block) {
+    Block toggled = block;
+    ToggleBlockStatic(toggled);
+    if (block.isStatic) {
+        RemoveStaticBlock(world, block.position);
+        AddBlock(blocks, grid, toggled);
+    } else {
+        if (!AddStaticBlock(world, PackStaticBlock(world, toggled))) return false;
+        RemoveBlock(blocks, grid, index);
+    }
+    return true;
+}
+
+// FNV-1a over the raw bits of every block's position, velocity and health,
+// followed by a digest of the static blocks
+unsigned long long HashWorldState(const std::vector<Block>& blocks, const StaticWorld& world) {
+    unsigned long long hash = 14695981039346656037ull;
+    auto mix = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+    };
+    size_t count = blocks.size();
+    mix(&count, sizeof(count));
+    for (const Block& block : blocks) {
+        mix(&block.position, sizeof(Vector3));
+        mix(&block.velocity, sizeof(Vector3));
+        mix(&block.health, sizeof(float));
+    }
+    // Brick table order depends on history and streaming, so static blocks
+    // are combined order-independently; streamed-out regions still count
+    unsigned long long staticSum = world.streamedSum;
+    ForEachStaticBlock(world, [&](const StaticBlock& block) {
+        staticSum += HashStaticBlock(block);
+    });
+    size_t staticCount = world.blockCount + world.streamedCount;
+    mix(&staticCount, sizeof(staticCount));
+    mix(&staticSum, sizeof(staticSum));
+    return hash;
+}
+
+// Player controller: the player's box is swept through the blocks around
+// the move and slides along whatever it touches, stepping up ledges no taller
+// than stepHeight. Obstacles come from the grid and the brick map around the
+// swept box only, so the cost doesn't grow with the world.
+#define PLAYER_SLIDES 4  // Contacts resolved per sweep
+
+struct PlayerObstacle {
+    BoundingBox box;
+    int block;                // Dynamic block index, or -1 for static geometry
+};
+
+struct PlayerController {
+    Vector3 size;
+    float stepHeight;
+    float skin;                               // Gap kept from surfaces after a hit
+    std::vector<PlayerObstacle> obstacles;    // Gathered again every step
+};
+
+struct PlayerSlide {
+    bool grounded;            // Landed on top of something
+    bool ceiling;
+    int pushed[PLAYER_SLIDES * 3];  // Dynamic blocks walked into
+    int pushedCount;
+};
+
+void InitPlayerController(PlayerController& controller, Vector3 size, float stepHeight) {
+    controller.size = size;
+    controller.stepHeight = stepHeight;
+    controller.skin = 0.001f;
+    controller.obstacles.clear();
+}
+
+bool BoxesOverlap(BoundingBox a, BoundingBox b) {
+    return a.min.x < b.max.x && a.max.x > b.min.x && a.min.y < b.max.y && 
+           a.max.y > b.min.y && a.min.z < b.max.z && a.max.z > b.min.z;
+}
+
+// Collects the blocks that overlap the region the player may sweep through
+void GatherPlayerObstacles(PlayerController& controller, const std::vector<Block>& blocks, const BlockGrid& grid, 
+                           const StaticWorld& world, Vector3 blockSize, BoundingBox region) {
+    controller.obstacles.clear();
+    Vector3 half = Vector3Scale(blockSize, 0.5f);
+    ForEachBlockInCells(grid, Vector3Subtract(region.min, half), Vector3Add(region.max, half), [&](int i) {
+        BoundingBox box = GetBlockBoundingBox(blocks[i], blockSize);
+        if (BoxesOverlap(box, region)) controller.obstacles.push_back((PlayerObstacle){ box, blocks[i].isStatic ? -1 : i });
+    });
+    ForEachStaticBlockInBox(world, region.min, region.max, [&](const StaticBlock& block) {
+        BoundingBox box = GetBlockBoundingBox(block, blockSize);
+        if (BoxesOverlap(box, region)) controller.obstacles.push_back((PlayerObstacle){ box, -1 });
+    });
+}
+
+// Fraction of motion the box covers before touching the obstacle, or 1 when
+// it doesn't. Obstacles the box already overlaps are let go of.
+float SweepBox(BoundingBox box, Vector3 motion, BoundingBox obstacle, int* axis) {
+    float move[3] = { motion.x, motion.y, motion.z };
+    float lo[3] = { box.min.x, box.min.y, box.min.z }, hi[3] = { box.max.x, box.max.y, box.max.z };
+    float olo[3] = { obstacle.min.x, obstacle.min.y, obstacle.min.z }, ohi[3] = { obstacle.max.x, obstacle.max.y, obstacle.max.z };
+    float entry = -INFINITY, exit = INFINITY;
+    int entryAxis = -1;
+    for (int a = 0; a < 3; a++) {
+        float enter, leave;
+        if (move[a] > 0.0f) {
+            enter = (olo[a] - hi[a]) / move[a];
+            leave = (ohi[a] - lo[a]) / move[a];
+        } else if (move[a] < 0.0f) {
+            enter = (ohi[a] - lo[a]) / move[a];
+            leave = (olo[a] - hi[a]) / move[a];
+        } else {
+            if (hi[a] <= olo[a] || lo[a] >= ohi[a]) return 1.0f;
+            continue;
+        }
+        if (enter > entry) {
+            entry = enter;
+            entryAxis = a;
+        }
+        exit = std::min(exit, leave);
+    }
+    if (entryAxis < 0 || entry >= exit || entry > 1.0f || entry < 0.0f) return 1.0f;
+    *axis = entryAxis;
+    return entry;
+}
+
+BoundingBox OffsetBox(BoundingBox box, Vector3 offset) {
+    return (BoundingBox){ Vector3Add(box.min, offset), Vector3Add(box.max, offset) };
+}
+
+// Moves the box as far along motion as it goes, sliding along each surface it meets
+void SlideBox(const PlayerController& controller, BoundingBox& box, Vector3 motion, PlayerSlide& slide) {
+    for (int iteration = 0; iteration < PLAYER_SLIDES; iteration++) {
+        if (Vector3LengthSqr(motion) < 1e-10f) return;
+        float first = 1.0f;
+        int hit = -1, axis = 0;
+        for (size_t o = 0; o < controller.obstacles.size(); o++) {
+            int hitAxis = 0;
+            float t = SweepBox(box, motion, controller.obstacles[o].box, &hitAxis);
+            if (t < first) {
+                first = t;
+                hit = (int)o;
+                axis = hitAxis;
+            }
+        }
+        
+        box = OffsetBox(box, Vector3Scale(motion, first));
+        if (hit < 0) return;
+        
+        // Back off by the skin, then keep only the motion along the surface
+        float* remaining[3] = { &motion.x, &motion.y, &motion.z };
+        float sign = *remaining[axis] > 0.0f ? -1.0f : 1.0f;
+        Vector3 normal = { axis == 0 ? sign : 0.0f, axis == 1 ? sign : 0.0f, axis == 2 ? sign : 0.0f };
+        box = OffsetBox(box, Vector3Scale(normal, controller.skin));
+        motion = Vector3Scale(motion, 1.0f - first);
+        *remaining[axis] = 0.0f;
+        
+        if (normal.y > 0.0f) slide.grounded = true;
+        if (normal.y < 0.0f) slide.ceiling = true;
+        int block = controller.obstacles[hit].block;
+        if (axis != 1 && block >= 0 && slide.pushedCount < PLAYER_SLIDES * 3) slide.pushed[slide.pushedCount++] = block;
+    }
+}
+
+// Moves the player (position is the top centre of its box) by velocity over
+// deltaTime. Blocked horizontal moves are retried a step up when the player
+// stands on something; velocity loses the parts stopped by surfaces.
+PlayerSlide MovePlayer(PlayerController& controller, Vector3& position, Vector3& velocity, bool grounded, float deltaTime) {
+    PlayerSlide slide = { false, false, {}, 0 };
+    BoundingBox start = GetPlayerBoundingBox(position, controller.size);
+    Vector3 horizontal = { velocity.x * deltaTime, 0.0f, velocity.z * deltaTime };
+    
+    BoundingBox box = start;
+    SlideBox(controller, box, horizontal, slide);
+    float progress = Vector3LengthSqr(Vector3Subtract(box.min, start.min));
+    if (grounded && controller.stepHeight > 0.0f && progress < Vector3LengthSqr(horizontal) * 0.99f) {
+        // Up, across, then back down onto the ledge
+        PlayerSlide stepSlide = { false, false, {}, 0 };
+        BoundingBox stepped = start;
+        SlideBox(controller, stepped, (Vector3){ 0.0f, controller.stepHeight, 0.0f }, stepSlide);
+        SlideBox(controller, stepped, horizontal, stepSlide);
+        SlideBox(controller, stepped, (Vector3){ 0.0f, -(stepped.min.y - start.min.y), 0.0f }, stepSlide);
+        Vector3 steppedMove = Vector3Subtract(stepped.min, start.min);
+        steppedMove.y = 0.0f;
+        if (stepSlide.grounded && Vector3LengthSqr(steppedMove) > progress + 1e-6f) {
+            box = stepped;
+            slide.grounded = true;
+        }
+    }
+    Vector3 moved = Vector3Subtract(box.min, start.min);
+    if (fabsf(moved.x) < fabsf(horizontal.x) - 1e-5f) velocity.x = 0.0f;
+    if (fabsf(moved.z) < fabsf(horizontal.z) - 1e-5f) velocity.z = 0.0f;
+    
+    SlideBox(controller, box, (Vector3){ 0.0f, velocity.y * deltaTime, 0.0f }, slide);
+    if (slide.grounded && velocity.y < 0.0f) velocity.y = 0.0f;
+    if (slide.ceiling && velocity.y > 0.0f) velocity.y = 0.0f;
+    
+    position = (Vector3){ (box.min.x + box.max.x) / 2, box.max.y, (box.min.z + box.max.z) / 2 };
+    return slide;
+}
+
+// Everything the player's box could touch this step, step-up included
+BoundingBox GetPlayerSweepRegion(const PlayerController& controller, Vector3 position, Vector3 velocity, float deltaTime) {
+    BoundingBox box = GetPlayerBoundingBox(position, controller.size);
+    BoundingBox moved = OffsetBox(box, Vector3Scale(velocity, deltaTime));
+    Vector3 pad = { 0.01f, controller.stepHeight + 0.01f, 0.01f };
+    return (BoundingBox){ Vector3Subtract(Vector3Min(box.min, moved.min), pad), Vector3Add(Vector3Max(box.max, moved.max), pad) };
+}
+
+// Ground probe: the highest block top under the player's footprint, no more
+// than depth below the feet. Static tops around the player's grid cell are
+// kept between frames and only gathered again when the player changes cell
+// or the static world changes; dynamic blocks move, so they're asked every call.
+struct GroundProbe {
+    bool valid;
+    int cell[3];                         // Grid cell of the player's feet the column was gathered for
+    unsigned int revision;               // StaticWorld revision it was gathered at
+    float depth;                         // How far below the feet a surface still counts
+    std::vector<BoundingBox> column;     // Static blocks reachable from anywhere in the cell
+};
+
+void InitGroundProbe(GroundProbe& probe, float depth) {
+    probe.valid = false;
+    probe.depth = depth;
+    probe.column.clear();
+}
+
+void InvalidateGroundProbe(GroundProbe& probe) {
+    probe.valid = false;
+}
+
+// Returns the probed surface height, or -INFINITY when nothing is in reach
+float ProbeGround(GroundProbe& probe, const std::vector<Block>& blocks, const BlockGrid& grid, const StaticWorld& world, 
+                  Vector3 blockSize, Vector3 position, Vector3 size) {
+    const float tolerance = 0.01f;   // Surfaces this far above the feet still count
+    Vector3 half = Vector3Scale(size, 0.5f);
+    Vector3 feet = { position.x, position.y - size.y, position.z };
+    int cell[3] = { GetCellCoord(grid, feet.x), GetCellCoord(grid, feet.y), GetCellCoord(grid, feet.z) };
+    
+    if (!probe.valid || probe.revision != world.revision || 
+        cell[0] != probe.cell[0] || cell[1] != probe.cell[1] || cell[2] != probe.cell[2]) {
+        // Everything any footprint whose feet lie in this cell could stand on
+        Vector3 cellMin = { cell[0] * grid.cellSize - 0.5f, cell[1] * grid.cellSize - 0.5f, cell[2] * grid.cellSize - 0.5f };
+        Vector3 cellMax = Vector3AddValue(cellMin, grid.cellSize);
+        Vector3 min = { cellMin.x - half.x, cellMin.y - probe.depth, cellMin.z - half.z };
+        Vector3 max = { cellMax.x + half.x, cellMax.y + tolerance, cellMax.z + half.z };
+        probe.column.clear();
+        ForEachStaticBlockInBox(world, min, max, [&](const StaticBlock& block) {
+            probe.column.push_back(GetBlockBoundingBox(block, blockSize));
+        });
+        memcpy(probe.cell, cell, sizeof(cell));
+        probe.revision = world.revision;
+        probe.valid = true;
+    }
+    
+    float ground = -INFINITY;
+    auto consider = [&](BoundingBox box) {
+        if (box.min.x >= feet.x + half.x || box.max.x <= feet.x - half.x || 
+            box.min.z >= feet.z + half.z || box.max.z <= feet.z - half.z) return;
+        if (box.max.y > feet.y + tolerance || box.max.y < feet.y - probe.depth) return;
+        ground = fmaxf(ground, box.max.y);
+    };
+    for (const BoundingBox& box : probe.column) consider(box);
+    
+    Vector3 reach = Vector3Scale(blockSize, 0.5f);
+    Vector3 min = { feet.x - half.x - reach.x, feet.y - probe.depth - reach.y, feet.z - half.z - reach.z };
+    Vector3 max = { feet.x + half.x + reach.x, feet.y + tolerance + reach.y, feet.z + half.z + reach.z };
+    ForEachBlockInCells(grid, min, max, [&](int i) {
+        consider(GetBlockBoundingBox(blocks[i], blockSize));
+    });
+    return ground;
+}
+
+// Procedural noise: hashes of integer coordinates, so any cell can be
+// evaluated alone, on any thread, in any order
+unsigned int HashNoise(unsigned int seed, int x, int y, int z) {
+    unsigned int h = seed * 0x9e3779b1u ^ (unsigned int)x * 0x85ebca6bu ^ (unsigned int)y * 0xc2b2ae35u ^ (unsigned int)z * 0x27d4eb2fu;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    h *= 0x297a2d39u;
+    h ^= h >> 15;
+    return h;
+}
+
+float GetNoiseRandom(unsigned int seed, int x, int y, int z) {
+    return (HashNoise(seed, x, y, z) & 0xffffff) / 16777216.0f;
+}
+
+// Smoothed value noise, four octaves, 0 to 1
+float GetValueNoise(unsigned int seed, float x, float z) {
+    float total = 0.0f, amplitude = 0.5f, frequency = 1.0f / 32.0f;
+    for (int octave = 0; octave < 4; octave++) {
+        float fx = x * frequency, fz = z * frequency;
+        int ix = (int)floorf(fx), iz = (int)floorf(fz);
+        float tx = fx - ix, tz = fz - iz;
+        tx = tx * tx * (3.0f - 2.0f * tx);
+        tz = tz * tz * (3.0f - 2.0f * tz);
+        float top = Lerp(GetNoiseRandom(seed, ix, octave, iz), GetNoiseRandom(seed, ix + 1, octave, iz), tx);
+        float bottom = Lerp(GetNoiseRandom(seed, ix, octave, iz + 1), GetNoiseRandom(seed, ix + 1, octave, iz + 1), tx);
+        total += amplitude * Lerp(top, bottom, tz);
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+    return total / 0.9375f;
+}
+
+// Camera frustum for CPU-side culling; planes face inwards
+struct Frustum {
+    Vector4 planes[6];  // Normal in xyz, distance in w
+};
+
+Vector4 GetFrustumPlane(Vector3 normal, Vector3 point) {
+    normal = Vector3Normalize(normal);
+    return (Vector4){ normal.x, normal.y, normal.z, -Vector3DotProduct(normal, point) };
+}
+
+// Side plane through the camera containing `edge` and `axis`, facing `forward`
+Vector4 GetFrustumSide(Vector3 position, Vector3 forward, Vector3 edge, Vector3 axis) {
+    Vector3 normal = Vector3CrossProduct(axis, edge);
+    if (Vector3DotProduct(normal, forward) < 0.0f) normal = Vector3Negate(normal);
+    return GetFrustumPlane(normal, position);
+}
+
+Frustum GetCameraFrustum(Camera3D camera, float aspect, float farDistance) {
+    Vector3 forward = Vector3Normalize(Vector3Subtract(camera.target, camera.position));
+    Vector3 right = Vector3Normalize(Vector3CrossProduct(forward, camera.up));
+    Vector3 up = Vector3CrossProduct(right, forward);
+    float halfHeight = tanf(camera.fovy * DEG2RAD * 0.5f), halfWidth = halfHeight * aspect;
+    
+    Frustum frustum;
+    frustum.planes[0] = GetFrustumSide(camera.position, forward, Vector3Subtract(forward, Vector3Scale(right, halfWidth)), up);
+    frustum.planes[1] = GetFrustumSide(camera.position, forward, Vector3Add(forward, Vector3Scale(right, halfWidth)), up);
+    frustum.planes[2] = GetFrustumSide(camera.position, forward, Vector3Subtract(forward, Vector3Scale(up, halfHeight)), right);
+    frustum.planes[3] = GetFrustumSide(camera.position, forward, Vector3Add(forward, Vector3Scale(up, halfHeight)), right);
+    frustum.planes[4] = GetFrustumPlane(forward, camera.position);
+    frustum.planes[5] = GetFrustumPlane(Vector3Negate(forward), Vector3Add(camera.position, Vector3Scale(forward, farDistance)));
+    return frustum;
+}
+
+// False only when the box is wholly outside one plane
+bool IsBoxInFrustum(const Frustum& frustum, BoundingBox box) {
+    for (const Vector4& plane : frustum.planes) {
+        Vector3 farthest = {
+            plane.x >= 0.0f ? box.max.x : box.min.x,
+            plane.y >= 0.0f ? box.max.y : box.min.y,
+            plane.z >= 0.0f ? box.max.z : box.min.z
+        };
+        if (plane.x * farthest.x + plane.y * farthest.y + plane.z * farthest.z + plane.w < 0.0f) return false;
+    }
+    return true;
+}
+
+// Terrain: a procedural heightfield sampled every `cellSize` units and
+// split into square chunks. Both the height queries and the renderer keep a
+// toroidal window of chunks: a chunk goes in the slot given by its
+// coordinates modulo the window, so loading one evicts whatever far chunk
+// held the slot and memory stays fixed however big the map is.
+#define TERRAIN_CHUNK 32     // Cells per chunk edge
+#define TERRAIN_WINDOW 32    // Chunks per window edge, power of two
+#define TERRAIN_LODS 4       // Each halves the samples per edge
+
+struct TerrainShape {
+    unsigned int seed;
+    float cellSize;
+    float amplitude;         // Tallest hill
+    float flatRadius;        // Ground stays at 0 within this distance of the origin
+};
+
+// Hills rise over 40 units past the flat radius
+float GetTerrainSample(const TerrainShape& shape, int x, int z) {
+    if (shape.amplitude == 0.0f) return 0.0f;
+    float worldX = x * shape.cellSize, worldZ = z * shape.cellSize;
+    float rise = Clamp((sqrtf(worldX*worldX + worldZ*worldZ) - shape.flatRadius) / 40.0f, 0.0f, 1.0f);
+    if (rise == 0.0f) return 0.0f;
+    rise = rise * rise * (3.0f - 2.0f * rise);
+    return shape.amplitude * rise * GetValueNoise(shape.seed, worldX / 8.0f, worldZ / 8.0f);
+}
+
+struct TerrainHeightChunk {
+    int x, z;
+    bool loaded;
+    std::vector<float> heights;  // (TERRAIN_CHUNK + 1)^2 samples, shared edges included
+};
+
+// Height queries, owned by whoever runs the simulation. The cache holds the
+// window of chunks around the focus; queries outside it evaluate the noise
+// directly rather than evicting chunks the focus still needs.
+struct TerrainHeights {
+    TerrainShape shape;
+    std::vector<TerrainHeightChunk> chunks;
+    int focusX, focusZ;      // Chunk the window is centred on
+};
+
+void InitTerrainHeights(TerrainHeights& terrain, const TerrainShape& shape) {
+    terrain.shape = shape;
+    terrain.chunks.assign(TERRAIN_WINDOW * TERRAIN_WINDOW, TerrainHeightChunk{ 0, 0, false, {} });
+    terrain.focusX = terrain.focusZ = 0;
+}
+
+void SetTerrainFocus(TerrainHeights& terrain, Vector3 position) {
+    terrain.focusX = FloorDiv((int)floorf(position.x / terrain.shape.cellSize), TERRAIN_CHUNK);
+    terrain.focusZ = FloorDiv((int)floorf(position.z / terrain.shape.cellSize), TERRAIN_CHUNK);
+}
+
+const float* GetTerrainChunkHeights(TerrainHeights& terrain, int chunkX, int chunkZ) {
+    TerrainHeightChunk& chunk = terrain.chunks[(chunkZ & (TERRAIN_WINDOW - 1)) * TERRAIN_WINDOW + (chunkX & (TERRAIN_WINDOW - 1))];
+    if (!chunk.loaded || chunk.x != chunkX || chunk.z != chunkZ) {
+        const int edge = TERRAIN_CHUNK + 1;
+        chunk.heights.resize(edge * edge);
+        for (int z = 0; z < edge; z++) {
+            for (int x = 0; x < edge; x++) {
+                chunk.heights[z * edge + x] = GetTerrainSample(terrain.shape, chunkX * TERRAIN_CHUNK + x, chunkZ * TERRAIN_CHUNK + z);
+            }
+        }
+        chunk.x = chunkX;
+        chunk.z = chunkZ;
+        chunk.loaded = true;
+    }
+    return chunk.heights.data();
+}
+
+// Bilinear between the four samples around the point
+float GetTerrainHeight(TerrainHeights& terrain, float x, float z) {
+    if (terrain.shape.amplitude == 0.0f) return 0.0f;
+    float cellX = x / terrain.shape.cellSize, cellZ = z / terrain.shape.cellSize;
+    int sampleX = (int)floorf(cellX), sampleZ = (int)floorf(cellZ);
+    int chunkX = FloorDiv(sampleX, TERRAIN_CHUNK), chunkZ = FloorDiv(sampleZ, TERRAIN_CHUNK);
+    float tx = cellX - sampleX, tz = cellZ - sampleZ;
+    
+    // Any TERRAIN_WINDOW consecutive chunks map to distinct slots
+    int offsetX = chunkX - terrain.focusX, offsetZ = chunkZ - terrain.focusZ;
+    if (offsetX < -TERRAIN_WINDOW/2 || offsetX >= TERRAIN_WINDOW/2 || offsetZ < -TERRAIN_WINDOW/2 || offsetZ >= TERRAIN_WINDOW/2) {
+        const TerrainShape& shape = terrain.shape;
+        return Lerp(Lerp(GetTerrainSample(shape, sampleX, sampleZ), GetTerrainSample(shape, sampleX + 1, sampleZ), tx),
+                    Lerp(GetTerrainSample(shape, sampleX, sampleZ + 1), GetTerrainSample(shape, sampleX + 1, sampleZ + 1), tx), tz);
+    }
+    const float* heights = GetTerrainChunkHeights(terrain, chunkX, chunkZ);
+    
+    const int edge = TERRAIN_CHUNK + 1;
+    int i = (sampleZ - chunkZ * TERRAIN_CHUNK) * edge + (sampleX - chunkX * TERRAIN_CHUNK);
+    return Lerp(Lerp(heights[i], heights[i + 1], tx), Lerp(heights[i + edge], heights[i + edge + 1], tx), tz);
+}
+
+// Highest ground under a box's footprint: its corners and centre
+float GetTerrainFootprintHeight(TerrainHeights& terrain, Vector3 center, Vector3 size) {
+    float halfX = size.x/2, halfZ = size.z/2;
+    float height = GetTerrainHeight(terrain, center.x, center.z);
+    height = std::max(height, GetTerrainHeight(terrain, center.x - halfX, center.z - halfZ));
+    height = std::max(height, GetTerrainHeight(terrain, center.x + halfX, center.z - halfZ));
+    height = std::max(height, GetTerrainHeight(terrain, center.x - halfX, center.z + halfZ));
+    height = std::max(height, GetTerrainHeight(terrain, center.x + halfX, center.z + halfZ));
+    return height;
+}
+
+struct TerrainMeshChunk {
+    int x, z;
+    bool built;
+    float minHeight, maxHeight;
+    Mesh lods[TERRAIN_LODS];
+};
+
+// Render side: LOD meshes for the chunks near the camera, main thread only
+struct TerrainRenderer {
+    TerrainShape shape;
+    std::vector<TerrainMeshChunk> chunks;
+    Material material;
+    float drawDistance;       // Must stay under half the window
+    float lodDistance;        // Each LOD covers this much more distance than the last
+    int buildBudget;          // Chunk builds per frame beyond the camera's own 3x3
+};
+
+void InitTerrainRenderer(TerrainRenderer& renderer, const TerrainShape& shape, float drawDistance) {
+    renderer.shape = shape;
+    TerrainMeshChunk empty = { 0, 0, false, 0.0f, 0.0f, {} };
+    renderer.chunks.assign(TERRAIN_WINDOW * TERRAIN_WINDOW, empty);
+    renderer.material = LoadMaterialDefault();
+    renderer.drawDistance = std::min(drawDistance, TERRAIN_WINDOW * TERRAIN_CHUNK * shape.cellSize * 0.45f);
+    renderer.lodDistance = TERRAIN_CHUNK * shape.cellSize * 2.0f;
+    renderer.buildBudget = 8;
+}
+
+// One LOD of a chunk: a grid every `step` samples plus skirts hanging from
+// its edges, which hide the cracks next to chunks at another LOD. Height is
+// shaded into the vertex colours.
+Mesh BuildTerrainMesh(const TerrainShape& shape, const float* heights, int chunkX, int chunkZ, int step) {
+    const int edge = TERRAIN_CHUNK + 1;
+    int cells = TERRAIN_CHUNK / step, side = cells + 1;
+    Mesh mesh = { 0 };
+    mesh.vertexCount = side * side + 4 * side;
+    mesh.triangleCount = cells * cells * 2 + 4 * cells * 2;
+    mesh.vertices = (float*)MemAlloc(mesh.vertexCount * 3 * sizeof(float));
+    mesh.colors = (unsigned char*)MemAlloc(mesh.vertexCount * 4);
+    mesh.indices = (unsigned short*)MemAlloc(mesh.triangleCount * 3 * sizeof(unsigned short));
+    
+    Color low = DARKGREEN, high = (Color){ 130, 110, 70, 255 };
+    int v = 0;
+    auto addVertex = [&](int x, int z, float drop) {
+        float height = heights[z * edge + x];
+        mesh.vertices[v*3 + 0] = (chunkX * TERRAIN_CHUNK + x) * shape.cellSize;
+        mesh.vertices[v*3 + 1] = height - drop;
+        mesh.vertices[v*3 + 2] = (chunkZ * TERRAIN_CHUNK + z) * shape.cellSize;
+        
+        // Light from the slope, taken across neighbouring samples
+        int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, TERRAIN_CHUNK);
+        int z0 = std::max(z - 1, 0), z1 = std::min(z + 1, TERRAIN_CHUNK);
+        float slopeX = (heights[z * edge + x1] - heights[z * edge + x0]) / ((x1 - x0) * shape.cellSize);
+        float slopeZ = (heights[z1 * edge + x] - heights[z0 * edge + x]) / ((z1 - z0) * shape.cellSize);
+        float light = Clamp(0.85f - 0.5f * slopeX - 0.3f * slopeZ, 0.5f, 1.0f);
+        Color color = ColorLerp(low, high, shape.amplitude > 0.0f ? Clamp(height / shape.amplitude, 0.0f, 1.0f) : 0.0f);
+        mesh.colors[v*4 + 0] = (unsigned char)(color.r * light);
+        mesh.colors[v*4 + 1] = (unsigned char)(color.g * light);
+        mesh.colors[v*4 + 2] = (unsigned char)(color.b * light);
+        mesh.colors[v*4 + 3] = 255;
+        v++;
+    };
+    
+    for (int z = 0; z < side; z++) {
+        for (int x = 0; x < side; x++) addVertex(x * step, z * step, 0.0f);
+    }
+    int t = 0;
+    auto addQuad = [&](int a, int b, int c, int d) {
+        unsigned short* out = mesh.indices + t * 3;
+        out[0] = (unsigned short)a; out[1] = (unsigned short)b; out[2] = (unsigned short)c;
+        out[3] = (unsigned short)c; out[4] = (unsigned short)b; out[5] = (unsigned short)d;
+        t += 2;
+    };
+    for (int z = 0; z < cells; z++) {
+        for (int x = 0; x < cells; x++) {
+            int corner = z * side + x;
+            addQuad(corner, corner + side, corner + 1, corner + side + 1);
+        }
+    }
+    
+    // Skirts: each edge again, dropped below the coarsest neighbour's error
+    float drop = shape.cellSize * step * 2.0f + shape.amplitude * 0.05f;
+    const int edges[4][4] = { { 0, 0, 1, 0 }, { 0, cells, 1, 0 }, { 0, 0, 0, 1 }, { cells, 0, 0, 1 } };
+    for (const int* e : edges) {
+        int first = v;
+        for (int k = 0; k < side; k++) addVertex((e[0] + e[2] * k) * step, (e[1] + e[3] * k) * step, drop);
+        for (int k = 0; k < cells; k++) {
+            int top = (e[1] + e[3] * k) * side + e[0] + e[2] * k;
+            int next = (e[1] + e[3] * (k + 1)) * side + e[0] + e[2] * (k + 1);
+            addQuad(top, first + k, next, first + k + 1);
+        }
+    }
+    
+    UploadMesh(&mesh, false);
+    return mesh;
+}
+
+void UnloadTerrainChunk(TerrainMeshChunk& chunk) {
+    if (!chunk.built) return;
+    for (int lod = 0; lod < TERRAIN_LODS; lod++) UnloadMesh(chunk.lods[lod]);
+    chunk.built = false;
+}
+
+void BuildTerrainChunk(TerrainRenderer& renderer, TerrainMeshChunk& chunk, int chunkX, int chunkZ, std::vector<float>& heights) {
+    UnloadTerrainChunk(chunk);
+    const int edge = TERRAIN_CHUNK + 1;
+    heights.resize(edge * edge);
+    chunk.minHeight = renderer.shape.amplitude;
+    chunk.maxHeight = 0.0f;
+    for (int z = 0; z < edge; z++) {
+        for (int x = 0; x < edge; x++) {
+            float height = GetTerrainSample(renderer.shape, chunkX * TERRAIN_CHUNK + x, chunkZ * TERRAIN_CHUNK + z);
+            heights[z * edge + x] = height;
+            chunk.minHeight = std::min(chunk.minHeight, height);
+            chunk.maxHeight = std::max(chunk.maxHeight, height);
+        }
+    }
+    for (int lod = 0; lod < TERRAIN_LODS; lod++) {
+        chunk.lods[lod] = BuildTerrainMesh(renderer.shape, heights.data(), chunkX, chunkZ, 1 << lod);
+    }
+    chunk.x = chunkX;
+    chunk.z = chunkZ;
+    chunk.built = true;
+}
+
+// Draws the chunks in range and in view, building missing ones within this
+// frame's budget. Returns the draw calls issued.
+int DrawTerrain(TerrainRenderer& renderer, Camera3D camera, float aspect, std::vector<float>& scratch) {
+    float chunkExtent = TERRAIN_CHUNK * renderer.shape.cellSize;
+    Frustum frustum = GetCameraFrustum(camera, aspect, renderer.drawDistance + chunkExtent);
+    int cameraX = (int)floorf(camera.position.x / chunkExtent), cameraZ = (int)floorf(camera.position.z / chunkExtent);
+    int reach = (int)ceilf(renderer.drawDistance / chunkExtent);
+    int budget = renderer.buildBudget;
+    int drawCalls = 0;
+    
+    // Skirts face both ways
+    rlDisableBackfaceCulling();
+    for (int chunkZ = cameraZ - reach; chunkZ <= cameraZ + reach; chunkZ++) {
+        for (int chunkX = cameraX - reach; chunkX <= cameraX + reach; chunkX++) {
+            TerrainMeshChunk& chunk = renderer.chunks[(chunkZ & (TERRAIN_WINDOW - 1)) * TERRAIN_WINDOW + (chunkX & (TERRAIN_WINDOW - 1))];
+            bool ready = chunk.built && chunk.x == chunkX && chunk.z == chunkZ;
+            
+            // Unbuilt chunks are culled against the full height range
+            BoundingBox box = {
+                { chunkX * chunkExtent, ready ? chunk.minHeight - chunkExtent : -chunkExtent, chunkZ * chunkExtent },
+                { (chunkX + 1) * chunkExtent, ready ? chunk.maxHeight : renderer.shape.amplitude, (chunkZ + 1) * chunkExtent }
+            };
+            float dx = std::max(std::max(box.min.x - camera.position.x, camera.position.x - box.max.x), 0.0f);
+            float dz = std::max(std::max(box.min.z - camera.position.z, camera.position.z - box.max.z), 0.0f);
+            float distance = sqrtf(dx*dx + dz*dz);
+            if (distance > renderer.drawDistance || !IsBoxInFrustum(frustum, box)) continue;
+            
+            if (!ready) {
+                bool near = abs(chunkX - cameraX) <= 1 && abs(chunkZ - cameraZ) <= 1;
+                if (!near && budget <= 0) continue;  // Next frame
+                BuildTerrainChunk(renderer, chunk, chunkX, chunkZ, scratch);
+                budget--;
+            }
+            int lod = std::min((int)(distance / renderer.lodDistance), TERRAIN_LODS - 1);
+            DrawMesh(chunk.lods[lod], renderer.material, MatrixIdentity());
+            drawCalls++;
+        }
+    }
+    rlEnableBackfaceCulling();
+    return drawCalls;
+}
+
+void UnloadTerrainRenderer(TerrainRenderer& renderer) {
+    for (TerrainMeshChunk& chunk : renderer.chunks) UnloadTerrainChunk(chunk);
+    UnloadMaterial(renderer.material);
+}
+
+// Ground grid: nested levels of lines every 1, 10 and 100 units. Each level
+// is one mesh of thin flat quads, built once around the origin and fading out
+// towards its rim. Drawing snaps every level to the camera, so the grid
+// follows it anywhere in the world at the same fixed cost.
+#define GRID_LEVELS 3
+#define GRID_HALF_LINES 50    // Lines on each side of the centre, per level
+#define GRID_SEGMENTS 20      // Pieces per line, so the fade follows the distance
+
+struct GridRenderer {
+    Mesh levels[GRID_LEVELS];
+    float spacing[GRID_LEVELS];
+    Material material;
+    float height;             // Plane the grid lies on
+    bool overlay;             // Drawn over the terrain instead of depth tested against it
+};
+
+Mesh BuildGridMesh(float spacing, float width, Color color) {
+    const int lines = 2 * GRID_HALF_LINES + 1;
+    int quads = 2 * lines * GRID_SEGMENTS;
+    Mesh mesh = { 0 };
+    mesh.vertexCount = quads * 4;
+    mesh.triangleCount = quads * 2;
+    mesh.vertices = (float*)MemAlloc(mesh.vertexCount * 3 * sizeof(float));
+    mesh.colors = (unsigned char*)MemAlloc(mesh.vertexCount * 4);
+    mesh.indices = (unsigned short*)MemAlloc(mesh.triangleCount * 3 * sizeof(unsigned short));
+    
+    float extent = GRID_HALF_LINES * spacing, piece = 2.0f * extent / GRID_SEGMENTS;
+    int v = 0, t = 0;
+    auto addVertex = [&](float along, float across, int axis) {
+        float x = axis == 0 ? along : across, z = axis == 0 ? across : along;
+        mesh.vertices[v*3 + 0] = x;
+        mesh.vertices[v*3 + 1] = 0.0f;
+        mesh.vertices[v*3 + 2] = z;
+        float fade = Clamp(1.0f - sqrtf(x*x + z*z) / extent, 0.0f, 1.0f);
+        mesh.colors[v*4 + 0] = color.r;
+        mesh.colors[v*4 + 1] = color.g;
+        mesh.colors[v*4 + 2] = color.b;
+        mesh.colors[v*4 + 3] = (unsigned char)(color.a * fade);
+        v++;
+    };
+    for (int axis = 0; axis < 2; axis++) {
+        for (int line = 0; line < lines; line++) {
+            float across = (line - GRID_HALF_LINES) * spacing;
+            for (int segment = 0; segment < GRID_SEGMENTS; segment++) {
+                float along = -extent + segment * piece;
+                int first = v;
+                addVertex(along, across - width/2, axis);
+                addVertex(along + piece, across - width/2, axis);
+                addVertex(along, across + width/2, axis);
+                addVertex(along + piece, across + width/2, axis);
+                
+                // Wound to face up for either axis
+                int a = first, b = axis == 0 ? first + 2 : first + 1, c = axis == 0 ? first + 1 : first + 2, d = first + 3;
+                unsigned short* out = mesh.indices + t * 3;
+                out[0] = (unsigned short)a; out[1] = (unsigned short)b; out[2] = (unsigned short)c;
+                out[3] = (unsigned short)c; out[4] = (unsigned short)b; out[5] = (unsigned short)d;
+                t += 2;
+            }
+        }
+    }
+    
+    UploadMesh(&mesh, false);
+    return mesh;
+}
+
+void InitGridRenderer(GridRenderer& grid, float height) {
+    const Color colors[GRID_LEVELS] = { (Color){ 130, 130, 130, 160 }, (Color){ 90, 90, 90, 200 }, (Color){ 60, 60, 60, 220 } };
+    float spacing = 1.0f;
+    for (int level = 0; level < GRID_LEVELS; level++) {
+        grid.spacing[level] = spacing;
+        grid.levels[level] = BuildGridMesh(spacing, spacing * 0.03f, colors[level]);
+        spacing *= 10.0f;
+    }
+    grid.material = LoadMaterialDefault();
+    grid.height = height;
+    grid.overlay = false;
+}
+
+// Returns the draw calls issued. An overlay grid stays visible where hills
+// rise above its plane; it writes no depth, so what is drawn after it still
+// hides it.
+int DrawGroundGrid(const GridRenderer& grid, Camera3D camera) {
+    int drawCalls = 0;
+    if (grid.overlay) {
+        rlDrawRenderBatchActive();
+        rlDisableDepthTest();
+        rlDisableDepthMask();
+    }
+    for (int level = 0; level < GRID_LEVELS; level++) {
+        float spacing = grid.spacing[level];
+        
+        // Levels the camera is too high above to see are skipped outright
+        if (fabsf(camera.position.y - grid.height) > GRID_HALF_LINES * spacing) continue;
+        float x = floorf(camera.position.x / spacing + 0.5f) * spacing;
+        float z = floorf(camera.position.z / spacing + 0.5f) * spacing;
+        DrawMesh(grid.levels[level], grid.material, MatrixTranslate(x, grid.height + 0.01f * (level + 1), z));
+        drawCalls++;
+    }
+    if (grid.overlay) {
+        rlEnableDepthMask();
+        rlEnableDepthTest();
+    }
+    return drawCalls;
+}
+
+void UnloadGridRenderer(GridRenderer& grid) {
+    for (int level = 0; level < GRID_LEVELS; level++) UnloadMesh(grid.levels[level]);
+    UnloadMaterial(grid.material);
+}
+
+// Support graph: dynamic blocks that stay still long enough fall asleep on
+// whatever holds them up. Sleepers skip gravity and contacts, and awake blocks
+// treat them as immovable. Each sleeper records the dynamic blocks it rests
+// on and each block lists the sleepers resting on it, so a removed or
+// disturbed block wakes only the stack above it.
+#define MAX_SUPPORTS 4  // Equal aligned boxes rest on at most four others
+
+struct SupportLink {
+    int dependent;
+    int next;
+};
+
+struct SupportGraph {
+    std::vector<unsigned char> asleep;   // Per block
+    std::vector<float> restTime;         // Per block: seconds spent nearly still
+    std::vector<int> supports;           // Per block: MAX_SUPPORTS sleepers it rests on, -1 padded
+    std::vector<int> firstDependent;     // Per block: head of the list of sleepers resting on it
+    std::vector<SupportLink> links;      // Link pool for the dependent lists
+    std::vector<int> freeLinks;
+    std::vector<int> wakeStack;          // Scratch for transitive wakes
+    float sleepDelay;                    // Seconds a block must rest before it sleeps
+    float sleepSpeed;                    // Slower blocks count as resting
+    float wakeSpeed;                     // Faster impacts wake a sleeper
+};
+
+// Everything awake, e.g. after the editor changed the world
+void ResetSupportGraph(SupportGraph& graph, size_t blockCount) {
+    graph.asleep.assign(blockCount, 0);
+    graph.restTime.assign(blockCount, 0.0f);
+    graph.supports.assign(blockCount * MAX_SUPPORTS, -1);
+    graph.firstDependent.assign(blockCount, -1);
+    graph.links.clear();
+    graph.freeLinks.clear();
+}
+
+void InitSupportGraph(SupportGraph& graph) {
+    graph.sleepDelay = 0.5f;
+    graph.sleepSpeed = 0.05f;
+    graph.wakeSpeed = 1.0f;
+    ResetSupportGraph(graph, 0);
+}
+
+// Call after AddBlock: new blocks start awake
+void AddSupportNode(SupportGraph& graph) {
+    graph.asleep.push_back(0);
+    graph.restTime.push_back(0.0f);
+    graph.supports.insert(graph.supports.end(), MAX_SUPPORTS, -1);
+    graph.firstDependent.push_back(-1);
+}
+
+void AddSupportLink(SupportGraph& graph, int support, int dependent) {
+    int link;
+    if (!graph.freeLinks.empty()) {
+        link = graph.freeLinks.back();
+        graph.freeLinks.pop_back();
+    } else {
+        link = (int)graph.links.size();
+        graph.links.push_back(SupportLink{ 0, 0 });
+    }
+    graph.links[link].dependent = dependent;
+    graph.links[link].next = graph.firstDependent[support];
+    graph.firstDependent[support] = link;
+}
+
+void RemoveSupportLink(SupportGraph& graph, int support, int dependent) {
+    for (int* link = &graph.firstDependent[support]; *link >= 0; link = &graph.links[*link].next) {
+        if (graph.links[*link].dependent == dependent) {
+            int freed = *link;
+            *link = graph.links[freed].next;
+            graph.freeLinks.push_back(freed);
+            return;
+        }
+    }
+}
+
+// Wakes the block and, transitively, every sleeper resting on it
+void WakeBlock(SupportGraph& graph, int index) {
+    graph.wakeStack.clear();
+    graph.wakeStack.push_back(index);
+    while (!graph.wakeStack.empty()) {
+        int i = graph.wakeStack.back();
+        graph.wakeStack.pop_back();
+        graph.restTime[i] = 0.0f;
+        if (!graph.asleep[i]) continue;
+        graph.asleep[i] = 0;
+        
+        for (int s = 0; s < MAX_SUPPORTS; s++) {
+            int& support = graph.supports[i * MAX_SUPPORTS + s];
+            if (support >= 0) RemoveSupportLink(graph, support, i);
+            support = -1;
+        }
+        for (int link = graph.firstDependent[i]; link >= 0; link = graph.links[link].next) {
+            graph.wakeStack.push_back(graph.links[link].dependent);
+            graph.freeLinks.push_back(link);
+        }
+        graph.firstDependent[i] = -1;
+    }
+}
+
+// Static geometry has no node in the graph, so sleepers resting on a static
+// block that goes away are found by position: every sleeper touching its box wakes
+void WakeBlocksTouching(SupportGraph& graph, const std::vector<Block>& blocks, const BlockGrid& grid, 
+                        Vector3 center, Vector3 blockSize) {
+    const float epsilon = 0.05f;
+    Vector3 half = Vector3AddValue(Vector3Scale(blockSize, 0.5f), epsilon);
+    BoundingBox box = { Vector3Subtract(center, half), Vector3Add(center, half) };
+    ForEachBlockInCells(grid, Vector3Subtract(box.min, half), Vector3Add(box.max, half), [&](int i) {
+        if (blocks[i].isStatic || !graph.asleep[i]) return;
+        if (BoxesOverlap(GetBlockBoundingBox(blocks[i], blockSize), box)) WakeBlock(graph, i);
+    });
+}
+
+// Call before RemoveBlock: wakes what rested on the removed block and moves
+// the last block's links into the freed slot, matching the swap-removal
+void RemoveSupportNode(SupportGraph& graph, int index) {
+    WakeBlock(graph, index);
+    int last = (int)graph.asleep.size() - 1;
+    if (index != last) {
+        for (int s = 0; s < MAX_SUPPORTS; s++) {
+            int support = graph.supports[last * MAX_SUPPORTS + s];
+            if (support < 0) continue;
+            for (int link = graph.firstDependent[support]; link >= 0; link = graph.links[link].next) {
+                if (graph.links[link].dependent == last) graph.links[link].dependent = index;
+            }
+        }
+        for (int link = graph.firstDependent[last]; link >= 0; link = graph.links[link].next) {
+            int* supports = &graph.supports[graph.links[link].dependent * MAX_SUPPORTS];
+            for (int s = 0; s < MAX_SUPPORTS; s++) {
+                if (supports[s] == last) supports[s] = index;
+            }
+        }
+        graph.asleep[index] = graph.asleep[last];
+        graph.restTime[index] = graph.restTime[last];
+        std::copy(graph.supports.begin() + last * MAX_SUPPORTS, graph.supports.begin() + (last + 1) * MAX_SUPPORTS, 
+                  graph.supports.begin() + index * MAX_SUPPORTS);
+        graph.firstDependent[index] = graph.firstDependent[last];
+    }
+    graph.asleep.pop_back();
+    graph.restTime.pop_back();
+    graph.supports.resize(last * MAX_SUPPORTS);
+    graph.firstDependent.pop_back();
+}
+
+#define CONTACT_STATIC (1ull << 62)   // Key flag: the rest is the static block's packed half-unit position
+#define CONTACT_GROUND (~0ull)
+
+// Contact solver: contacts between dynamic blocks, static blocks and the
+// ground are built once per step and solved with sequential impulses. Blocks
+// are axis-aligned boxes of equal mass, so every contact normal is a world axis
+// and the other two axes are its friction directions. Accumulated impulses are
+// matched to last step's contacts by pair and reused as a warm start, which
+// lets resting stacks settle within the fixed iteration budget.
+struct Contact {
+    int a;                    // Dynamic block
+    unsigned long long key;   // The other body: block index, packed static position or CONTACT_GROUND
+    int b;                    // Other block, -1 for static geometry, -2 for the ground
+    bool bMoves;              // b is awake and takes impulses; sleepers act as static
+    StaticBlock staticBlock;  // The static body when b is -1
+    int axis;                 // Normal axis: 0 x, 1 y, 2 z
+    float sign;               // Normal points along +axis or -axis, from b towards a
+    float depth;              // Penetration, negative while still apart
+    float approachSpeed;      // Closing speed along the normal when the contact was built
+    float bounce;             // Separating speed wanted from restitution
+    float normalImpulse;
+    float tangentImpulse[2];
+};
+
+struct ContactSolver {
+    std::vector<Contact> contacts;    // This step, sorted by key
+    std::vector<Contact> previous;    // Last step, for warm starting
+    unsigned int gridGeneration;      // Block grid generation the cache was built for
+    int iterations;
+    float friction;                   // Coulomb coefficient
+    float restitution;
+    float bounceThreshold;            // Slower impacts don't bounce
+    float margin;                     // Speculative contact distance
+    float slop;                       // Penetration left uncorrected
+    float baumgarte;                  // Share of the penetration corrected per step
+};
+
+void InitContactSolver(ContactSolver& solver) {
+    solver.contacts.clear();
+    solver.previous.clear();
+    solver.gridGeneration = 0;
+    solver.iterations = 8;
+    solver.friction = 0.4f;
+    solver.restitution = 0.3f;
+    solver.bounceThreshold = 2.0f;
+    solver.margin = 0.05f;
+    solver.slop = 0.01f;
+    solver.baumgarte = 0.2f;
+}
+
+// Forgets this and last step's contacts, e.g. when the world is replaced
+void ClearContactCache(ContactSolver& solver) {
+    solver.contacts.clear();
+    solver.previous.clear();
+}
+
+// Fills the normal and depth of a box pair, false if they are farther apart than margin
+bool GetBoxContact(Vector3 a, Vector3 b, Vector3 size, float margin, Contact& contact) {
+    float d[3] = { a.x - b.x, a.y - b.y, a.z - b.z };
+    float extent[3] = { size.x, size.y, size.z };
+    int axis = 0;
+    float overlap[3];
+    for (int i = 0; i < 3; i++) {
+        overlap[i] = extent[i] - fabsf(d[i]);
+        if (overlap[i] < overlap[axis]) axis = i;
+    }
+    if (overlap[axis] < -margin) return false;
+    // A speculative contact still needs the faces to overlap on the other axes
+    if (overlap[axis] < 0.0f && (overlap[(axis + 1) % 3] <= 0.0f || overlap[(axis + 2) % 3] <= 0.0f)) return false;
+    
+    contact.axis = axis;
+    contact.sign = (d[axis] >= 0.0f) ? 1.0f : -1.0f;
+    contact.depth = overlap[axis];
+    return true;
+}
+
+// Contacts are ordered by block a, then by the other body
+bool IsContactBefore(const Contact& x, const Contact& y) {
+    return x.a < y.a || (x.a == y.a && x.key < y.key);
+}
+
+void AddContact(ContactSolver& solver, const std::vector<Block>& blocks, Contact contact, 
+                int a, int b, bool bMoves, unsigned long long other, float deltaTime) {
+    contact.key = other;
+    contact.a = a;
+    contact.b = b;
+    contact.bMoves = bMoves;
+    const float* va = &blocks[a].velocity.x;
+    float relative = va[contact.axis] - (b >= 0 ? (&blocks[b].velocity.x)[contact.axis] : 0.0f);
+    contact.approachSpeed = -relative * contact.sign;
+    // Speculative contacts only count as impacts if the gap closes this step
+    if (contact.depth + contact.approachSpeed * deltaTime < 0.0f) contact.approachSpeed = 0.0f;
+    contact.bounce = 0.0f;
+    contact.normalImpulse = contact.tangentImpulse[0] = contact.tangentImpulse[1] = 0.0f;
+    solver.contacts.push_back(contact);
+}
+
+// Broad phase through the dynamic grid and the static brick map, each awake
+// pair once, then warm starts from last step's matching contacts. Sleeping
+// blocks only appear as the immovable side of contacts with awake ones.
+// Returns the number of pairs tested.
+long long BuildContacts(ContactSolver& solver, const std::vector<Block>& blocks, const BlockGrid& grid, 
+                   const StaticWorld& world, const SupportGraph& graph, Vector3 blockSize, 
+                   TerrainHeights& terrain, float deltaTime) {
+    solver.previous.swap(solver.contacts);
+    solver.contacts.clear();
+    if (grid.generation != solver.gridGeneration) solver.previous.clear();  // Indices moved
+    solver.gridGeneration = grid.generation;
+    
+    Vector3 reach = Vector3AddValue(blockSize, solver.margin);
+    long long pairTests = 0;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        if (blocks[i].isStatic || graph.asleep[i]) continue;
+        Vector3 position = blocks[i].position;
+        Contact contact;
+        
+        ForEachBlockInCells(grid, Vector3Subtract(position, reach), Vector3Add(position, reach), [&](int j) {
+            bool awake = !graph.asleep[j];
+            if ((awake && j <= (int)i) || blocks[j].isStatic) return;
+            pairTests++;
+            if (GetBoxContact(position, blocks[j].position, blockSize, solver.margin, contact)) {
+                AddContact(solver, blocks, contact, (int)i, j, awake, (unsigned long long)j, deltaTime);
+            }
+        });
+        
+        BoundingBox box = GetBlockBoundingBox(blocks[i], blockSize);
+        Vector3 margin = { solver.margin, solver.margin, solver.margin };
+        ForEachStaticBlockInBox(world, Vector3Subtract(box.min, margin), Vector3Add(box.max, margin), 
+            [&](const StaticBlock& block) {
+                pairTests++;
+                if (GetBoxContact(position, GetBlockCenter(block), blockSize, solver.margin, contact)) {
+                    // Static bodies are told apart by their packed position
+                    unsigned long long other = CONTACT_STATIC | (unsigned long long)(unsigned short)block.x << 32 | 
+                                               (unsigned long long)(unsigned short)block.y << 16 | (unsigned short)block.z;
+                    AddContact(solver, blocks, contact, (int)i, -1, false, other, deltaTime);
+                    solver.contacts.back().staticBlock = block;
+                }
+            });
+        
+        contact.depth = GetTerrainFootprintHeight(terrain, position, blockSize) + blockSize.y/2 - position.y;
+        if (contact.depth >= -solver.margin) {
+            contact.axis = 1;
+            contact.sign = 1.0f;
+            AddContact(solver, blocks, contact, (int)i, -2, false, CONTACT_GROUND, deltaTime);
+        }
+    }
+    
+    std::sort(solver.contacts.begin(), solver.contacts.end(), IsContactBefore);
+    
+    // Both lists are sorted, so matching is a single merge pass
+    size_t p = 0;
+    for (Contact& contact : solver.contacts) {
+        while (p < solver.previous.size() && IsContactBefore(solver.previous[p], contact)) p++;
+        if (p < solver.previous.size() && solver.previous[p].a == contact.a && solver.previous[p].key == contact.key &&
+            solver.previous[p].axis == contact.axis && solver.previous[p].sign == contact.sign) {
+            contact.normalImpulse = solver.previous[p].normalImpulse;
+            contact.tangentImpulse[0] = solver.previous[p].tangentImpulse[0];
+            contact.tangentImpulse[1] = solver.previous[p].tangentImpulse[1];
+        }
+    }
+    return pairTests;
+}
+
+void ApplyContactImpulse(std::vector<Block>& blocks, const Contact& contact, int axis, float impulse) {
+    (&blocks[contact.a].velocity.x)[axis] += impulse;
+    if (contact.bMoves) (&blocks[contact.b].velocity.x)[axis] -= impulse;
+}
+
+void SolveContacts(ContactSolver& solver, std::vector<Block>& blocks, float deltaTime) {
+    // Restitution targets and warm start
+    for (Contact& contact : solver.contacts) {
+        if (contact.approachSpeed > solver.bounceThreshold) contact.bounce = solver.restitution * contact.approachSpeed;
+        int u = (contact.axis + 1) % 3, v = (contact.axis + 2) % 3;
+        ApplyContactImpulse(blocks, contact, contact.axis, contact.normalImpulse * contact.sign);
+        ApplyContactImpulse(blocks, contact, u, contact.tangentImpulse[0]);
+        ApplyContactImpulse(blocks, contact, v, contact.tangentImpulse[1]);
+    }
+    
+    for (int iteration = 0; iteration < solver.iterations; iteration++) {
+        for (Contact& contact : solver.contacts) {
+            float invMass = contact.bMoves ? 0.5f : 1.0f;  // 1 / (1/mA + 1/mB), unit masses
+            const float* va = &blocks[contact.a].velocity.x;
+            const float* vb = contact.bMoves ? &blocks[contact.b].velocity.x : NULL;
+            
+            // Normal: speculative contacts may close the gap, penetration is pushed out
+            float relative = (va[contact.axis] - (vb ? vb[contact.axis] : 0.0f)) * contact.sign;
+            float target = (contact.depth < 0.0f) ? contact.depth / deltaTime :
+                fmaxf(solver.baumgarte * fmaxf(contact.depth - solver.slop, 0.0f) / deltaTime, contact.bounce);
+            float total = fmaxf(contact.normalImpulse + (target - relative) * invMass, 0.0f);
+            float impulse = total - contact.normalImpulse;
+            contact.normalImpulse = total;
+            ApplyContactImpulse(blocks, contact, contact.axis, impulse * contact.sign);
+            
+            // Friction on the two other axes, bounded by the normal impulse
+            float limit = solver.friction * contact.normalImpulse;
+            for (int t = 0; t < 2; t++) {
+                int axis = (contact.axis + 1 + t) % 3;
+                float slide = va[axis] - (vb ? vb[axis] : 0.0f);
+                total = Clamp(contact.tangentImpulse[t] - slide * invMass, -limit, limit);
+                impulse = total - contact.tangentImpulse[t];
+                contact.tangentImpulse[t] = total;
+                ApplyContactImpulse(blocks, contact, axis, impulse);
+            }
+        }
+    }
+}
+
+// Damage events: hard contacts are collected into one buffer per step and
+// resolved in a single pass, so every victim's health changes once and in a
+// fixed order. The events only read contacts as they were built, so they can
+// be gathered while the solver runs. The victim list is what destruction and
+// other damage reactions read; it holds until blocks are next removed. Static
+// geometry has no health: hits above the break speed go to the broken list.
+struct DamageEvent {
+    int attacker;   // Other block, -1 for static geometry, -2 for the ground
+    int victim;     // Dynamic block taking the damage
+    float impulse;  // Closing speed of the contact, blocks have unit mass
+};
+
+struct DamageBuffer {
+    std::vector<DamageEvent> events;
+    std::vector<int> victims;   // Blocks damaged by the last resolve, ascending
+    std::vector<StaticBlock> staticHits;    // Static blocks hit past the break speed, repeats included
+    std::vector<StaticBlock> brokenStatic;  // Static blocks broken by the last resolve, each once
+    float threshold;            // Softer impacts do no damage
+    float multiplier;           // Health lost per unit of impulse above the threshold
+    float staticBreakSpeed;     // Impacts this fast break static blocks
+};
+
+void InitDamageBuffer(DamageBuffer& buffer, float threshold, float multiplier, float staticBreakSpeed) {
+    buffer.events.clear();
+    buffer.victims.clear();
+    buffer.staticHits.clear();
+    buffer.brokenStatic.clear();
+    buffer.threshold = threshold;
+    buffer.multiplier = multiplier;
+    buffer.staticBreakSpeed = staticBreakSpeed;
+}
+
+// One event per damaged side of every hard contact
+void CollectDamageEvents(DamageBuffer& buffer, const ContactSolver& solver) {
+    buffer.events.clear();
+    buffer.staticHits.clear();
+    for (const Contact& contact : solver.contacts) {
+        if (contact.b == -1 && contact.approachSpeed > buffer.staticBreakSpeed) buffer.staticHits.push_back(contact.staticBlock);
+        if (contact.approachSpeed <= buffer.threshold) continue;
+        buffer.events.push_back(DamageEvent{ contact.b, contact.a, contact.approachSpeed });
+        if (contact.b >= 0) buffer.events.push_back(DamageEvent{ contact.a, contact.b, contact.approachSpeed });
+    }
+}
+
+// Sorts by victim, then attacker, hardest hit first. Repeated hits between
+// the same two bodies count once, at their hardest. Returns the victim count.
+int ResolveDamage(DamageBuffer& buffer, std::vector<Block>& blocks) {
+    std::sort(buffer.events.begin(), buffer.events.end(), [](const DamageEvent& x, const DamageEvent& y) {
+        if (x.victim != y.victim) return x.victim < y.victim;
+        if (x.attacker != y.attacker) return x.attacker < y.attacker;
+        return x.impulse > y.impulse;
+    });
+    
+    buffer.victims.clear();
+    size_t count = buffer.events.size();
+    for (size_t e = 0; e < count; ) {
+        int victim = buffer.events[e].victim;
+        float damage = 0.0f;
+        while (e < count && buffer.events[e].victim == victim) {
+            int attacker = buffer.events[e].attacker;
+            damage += (buffer.events[e].impulse - buffer.threshold) * buffer.multiplier;
+            while (e < count && buffer.events[e].victim == victim && buffer.events[e].attacker == attacker) e++;
+        }
+        blocks[victim].health -= damage;
+        buffer.victims.push_back(victim);
+    }
+    
+    // A static block hit by several blocks still breaks once
+    std::sort(buffer.staticHits.begin(), buffer.staticHits.end(), [](const StaticBlock& x, const StaticBlock& y) {
+        if (x.y != y.y) return x.y < y.y;
+        if (x.x != y.x) return x.x < y.x;
+        return x.z < y.z;
+    });
+    buffer.brokenStatic.clear();
+    for (const StaticBlock& block : buffer.staticHits) {
+        const StaticBlock* last = buffer.brokenStatic.empty() ? NULL : &buffer.brokenStatic.back();
+        if (!last || last->x != block.x || last->y != block.y || last->z != block.z) buffer.brokenStatic.push_back(block);
+    }
+    return (int)buffer.victims.size();
+}
+
+// Sleepers hit hard enough wake up, together with everything resting on them
+void WakeOnImpact(SupportGraph& graph, const ContactSolver& solver) {
+    for (const Contact& contact : solver.contacts) {
+        if (contact.b >= 0 && !contact.bMoves && contact.approachSpeed > graph.wakeSpeed) WakeBlock(graph, contact.b);
+    }
+}
+
+// Puts blocks to sleep that have rested long enough on the ground, static
+// geometry or sleeping blocks, linking them to the sleepers below. Stacks fall
+// asleep from the bottom up, one layer per step.
+int UpdateSupportGraph(SupportGraph& graph, const ContactSolver& solver, std::vector<Block>& blocks, 
+                       FrameArena& arena, float deltaTime) {
+    size_t count = blocks.size();
+    for (size_t i = 0; i < count; i++) {
+        if (graph.asleep[i] || blocks[i].isStatic) continue;
+        if (Vector3Length(blocks[i].velocity) < graph.sleepSpeed) graph.restTime[i] += deltaTime;
+        else graph.restTime[i] = 0.0f;
+    }
+    
+    // A block rests on whatever pushes it up; it can't sleep on an awake block
+    enum { UNSUPPORTED, SUPPORTED, BLOCKED };
+    unsigned char* state = ArenaAllocArray<unsigned char>(arena, count);
+    int* found = ArenaAllocArray<int>(arena, count * MAX_SUPPORTS);
+    memset(state, UNSUPPORTED, count);
+    for (size_t i = 0; i < count * MAX_SUPPORTS; i++) found[i] = -1;
+    
+    for (const Contact& contact : solver.contacts) {
+        if (contact.axis != 1 || contact.normalImpulse <= 0.0f) continue;
+        int upper = (contact.sign > 0.0f) ? contact.a : contact.b;
+        int lower = (contact.sign > 0.0f) ? contact.b : contact.a;
+        if (upper < 0 || graph.asleep[upper] || graph.restTime[upper] < graph.sleepDelay) continue;
+        
+        if (lower >= 0 && !graph.asleep[lower]) {
+            state[upper] = BLOCKED;
+        } else if (state[upper] != BLOCKED) {
+            state[upper] = SUPPORTED;
+            for (int s = 0; s < MAX_SUPPORTS && lower >= 0; s++) {
+                if (found[upper * MAX_SUPPORTS + s] < 0) {
+                    found[upper * MAX_SUPPORTS + s] = lower;
+                    break;
+                }
+            }
+        }
+    }
+    
+    int sleeping = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (state[i] == SUPPORTED) {
+            graph.asleep[i] = 1;
+            blocks[i].velocity = (Vector3){ 0.0f, 0.0f, 0.0f };
+            for (int s = 0; s < MAX_SUPPORTS; s++) {
+                int support = found[i * MAX_SUPPORTS + s];
+                graph.supports[i * MAX_SUPPORTS + s] = support;
+                if (support >= 0) AddSupportLink(graph, support, (int)i);
+            }
+        }
+        if (graph.asleep[i]) sleeping++;
+    }
+    return sleeping;
+}
+
+// Structural collapse: static blocks hold each other up through shared faces
+// and are anchored by the ones standing on the ground. After a static block
+// breaks, each former neighbour starts a flood fill that always expands its
+// lowest block first, so a supported part usually reaches the ground within a
+// few dozen blocks. A fill that runs out of blocks without reaching the ground
+// found a loose island, which becomes dynamic and falls. Visited voxels are
+// stamped with the fill that found them: reaching another fill's block means
+// sharing its support. The node budget bounds the cost of one break; fills
+// cut short by it assume support.
+struct CollapseSearch {
+    std::vector<long long> keys;        // Open-addressed voxel keys, power-of-two size
+    std::vector<unsigned int> marks;    // Fill stamp per slot, stamps before firstStamp count as empty
+    unsigned int firstStamp;            // First fill of the current break
+    unsigned int nextStamp;
+    size_t marked;                      // Slots stamped this break
+    std::vector<StaticBlock> frontier;  // Min-heap on height
+    std::vector<StaticBlock> island;    // Blocks reached by the current fill
+    std::vector<StaticBlock> starts;
+    int budget;                         // Blocks visited per break before giving up
+};
+
+void InitCollapseSearch(CollapseSearch& search, int budget) {
+    // Every visited block stamps its neighbours too: six on a regular lattice,
+    // more for offset blocks, which the fill treats like running out of budget
+    size_t size = 64;
+    while (size < ((size_t)budget * 6 + 6) * 2) size *= 2;
+    search.keys.assign(size, 0);
+    search.marks.assign(size, 0);
+    search.firstStamp = search.nextStamp = 1;
+    search.marked = 0;
+    search.frontier.reserve(budget);
+    search.island.reserve(budget);
+    search.budget = budget;
+}
+
+long long GetStaticBlockKey(const StaticBlock& block) {
+    int voxel[3], offset[3];
+    GetStaticVoxelCoords(block, voxel, offset);
+    return GetCellKey(voxel[0], voxel[1], voxel[2]);
+}
+
+// Returns the stamp the voxel already had this break, or 0 after stamping it with fill
+unsigned int MarkCollapseVisited(CollapseSearch& search, long long key, unsigned int fill) {
+    size_t mask = search.keys.size() - 1;
+    size_t slot = (size_t)HashCellKey(key) & mask;
+    while (search.marks[slot] >= search.firstStamp) {
+        if (search.keys[slot] == key) return search.marks[slot];
+        slot = (slot + 1) & mask;
+    }
+    search.keys[slot] = key;
+    search.marks[slot] = fill;
+    search.marked++;
+    return 0;
+}
+
+// Calls visit for static blocks sharing a face with block
+template <typename Visitor>
+void ForEachStaticNeighbor(const StaticWorld& world, const StaticBlock& block, Vector3 blockSize, Visitor visit) {
+    const float epsilon = 0.01f;
+    Vector3 center = GetBlockCenter(block);
+    BoundingBox box = GetBlockBoundingBox(block, blockSize);
+    Vector3 pad = { epsilon, epsilon, epsilon };
+    ForEachStaticBlockInBox(world, Vector3Subtract(box.min, pad), Vector3Add(box.max, pad), [&](const StaticBlock& other) {
+        Vector3 d = Vector3Subtract(GetBlockCenter(other), center);
+        float overlap[3] = { blockSize.x - fabsf(d.x), blockSize.y - fabsf(d.y), blockSize.z - fabsf(d.z) };
+        int touching = 0, sharing = 0;
+        for (int a = 0; a < 3; a++) {
+            if (overlap[a] < -epsilon) return;
+            if (overlap[a] > epsilon) sharing++;
+            else touching++;
+        }
+        if (touching == 1 && sharing == 2) visit(other);
+    });
+}
+
+// Releases static blocks cut off from the ground by the removal of the block
+// at removedCenter into the dynamic store. Returns how many were released.
+int CollapseStaticIslands(CollapseSearch& search, StaticWorld& world, std::vector<Block>& blocks, BlockGrid& grid, 
+                          SupportGraph& graph, StaticBlock removed, Vector3 blockSize, TerrainHeights& terrain) {
+    search.starts.clear();
+    ForEachStaticNeighbor(world, removed, blockSize, [&](const StaticBlock& block) { search.starts.push_back(block); });
+    if (search.starts.empty()) return 0;
+    
+    // Fresh stamps for this break; wrapping clears the table
+    if (search.nextStamp > 0xffffffffu - (unsigned int)search.starts.size()) {
+        std::fill(search.marks.begin(), search.marks.end(), 0);
+        search.nextStamp = 1;
+    }
+    search.firstStamp = search.nextStamp;
+    search.nextStamp += (unsigned int)search.starts.size();
+    search.marked = 0;
+    
+    auto higher = [](const StaticBlock& x, const StaticBlock& y) { return x.y > y.y; };
+    int visited = 0, released = 0;
+    for (size_t s = 0; s < search.starts.size(); s++) {
+        unsigned int fill = search.firstStamp + (unsigned int)s;
+        if (MarkCollapseVisited(search, GetStaticBlockKey(search.starts[s]), fill) != 0) continue;  // Joined an earlier fill
+        
+        search.frontier.clear();
+        search.island.clear();
+        search.frontier.push_back(search.starts[s]);
+        bool supported = false;
+        while (!search.frontier.empty() && !supported) {
+            std::pop_heap(search.frontier.begin(), search.frontier.end(), higher);
+            StaticBlock block = search.frontier.back();
+            search.frontier.pop_back();
+            search.island.push_back(block);
+            
+            Vector3 center = GetBlockCenter(block);
+            if (center.y - blockSize.y/2 <= GetTerrainFootprintHeight(terrain, center, blockSize) + 0.01f || 
+                ++visited > search.budget) {
+                supported = true;
+                break;
+            }
+            ForEachStaticNeighbor(world, block, blockSize, [&](const StaticBlock& next) {
+                // A half-full table keeps probe chains short and always ends them
+                if (search.marked * 2 >= search.keys.size()) {
+                    supported = true;
+                    return;
+                }
+                unsigned int mark = MarkCollapseVisited(search, GetStaticBlockKey(next), fill);
+                if (mark == 0) {
+                    search.frontier.push_back(next);
+                    std::push_heap(search.frontier.begin(), search.frontier.end(), higher);
+                } else if (mark != fill) {
+                    supported = true;  // An earlier fill of this break holds it up
+                }
+            });
+        }
+        if (supported) continue;
+        
+        for (const StaticBlock& block : search.island) {
+            Block loose = UnpackStaticBlock(world, block);
+            ToggleBlockStatic(loose);
+            WakeBlocksTouching(graph, blocks, grid, loose.position, blockSize);
+            RemoveStaticBlock(world, loose.position);
+            AddBlock(blocks, grid, loose);
+            AddSupportNode(graph);
+        }
+        released += (int)search.island.size();
+    }
+    return released;
+}
+
+// Debris: destroyed blocks burst into short-lived chunks. Particles live in a
+// fixed-capacity pool of separate arrays, one per component, so the update
+// loops run over contiguous floats without branches and the compiler turns
+// them into SIMD. Dead particles are swapped out, keeping the live range packed.
+#define DEBRIS_CAPACITY 16384
+
+struct DebrisPool {
+    std::vector<float> x, y, z;
+    std::vector<float> vx, vy, vz;
+    std::vector<float> life;       // Seconds left
+    std::vector<float> floor;      // Resting height, sampled once per burst
+    std::vector<Color> color;
+    int count;
+    unsigned int seed;             // Own generator, keeps replays and checksums unaffected
+    float lifetime;
+    float size;                    // Edge of a debris quad
+};
+
+void InitDebrisPool(DebrisPool& pool) {
+    pool.x.assign(DEBRIS_CAPACITY, 0.0f);
+    pool.y.assign(DEBRIS_CAPACITY, 0.0f);
+    pool.z.assign(DEBRIS_CAPACITY, 0.0f);
+    pool.vx.assign(DEBRIS_CAPACITY, 0.0f);
+    pool.vy.assign(DEBRIS_CAPACITY, 0.0f);
+    pool.vz.assign(DEBRIS_CAPACITY, 0.0f);
+    pool.life.assign(DEBRIS_CAPACITY, 0.0f);
+    pool.floor.assign(DEBRIS_CAPACITY, 0.0f);
+    pool.color.assign(DEBRIS_CAPACITY, BLANK);
+    pool.count = 0;
+    pool.seed = 0x9e3779b9u;
+    pool.lifetime = 1.5f;
+    pool.size = 0.3f;
+}
+
+float GetDebrisRandom(DebrisPool& pool) {
+    pool.seed ^= pool.seed << 13;
+    pool.seed ^= pool.seed >> 17;
+    pool.seed ^= pool.seed << 5;
+    return (pool.seed & 0xffffff) / 16777216.0f;
+}
+
+// Scatters pieces from inside the block's volume; drops what doesn't fit.
+// The whole burst rests on the ground sampled under the block.
+void SpawnDebris(DebrisPool& pool, TerrainHeights& terrain, Vector3 center, Vector3 blockSize, Color color, int pieces) {
+    float ground = GetTerrainHeight(terrain, center.x, center.z) + pool.size/2;
+    for (int p = 0; p < pieces && pool.count < DEBRIS_CAPACITY; p++) {
+        int i = pool.count++;
+        float ox = GetDebrisRandom(pool) - 0.5f, oy = GetDebrisRandom(pool) - 0.5f, oz = GetDebrisRandom(pool) - 0.5f;
+        pool.x[i] = center.x + ox * blockSize.x;
+        pool.y[i] = center.y + oy * blockSize.y;
+        pool.z[i] = center.z + oz * blockSize.z;
+        pool.vx[i] = ox * 8.0f;
+        pool.vy[i] = 3.0f + GetDebrisRandom(pool) * 4.0f;
+        pool.vz[i] = oz * 8.0f;
+        pool.life[i] = pool.lifetime * (0.5f + 0.5f * GetDebrisRandom(pool));
+        pool.floor[i] = ground;
+        pool.color[i] = color;
+    }
+}
+
+void UpdateDebris(DebrisPool& pool, float gravity, float deltaTime) {
+    int count = pool.count;
+    float* x = pool.x.data(); float* y = pool.y.data(); float* z = pool.z.data();
+    float* vx = pool.vx.data(); float* vy = pool.vy.data(); float* vz = pool.vz.data();
+    float* life = pool.life.data();
+    const float* floor = pool.floor.data();
+    
+    // Short loops over one or two arrays keep the aliasing checks cheap enough to vectorize
+    for (int i = 0; i < count; i++) vy[i] -= gravity * deltaTime;
+    for (int i = 0; i < count; i++) x[i] += vx[i] * deltaTime;
+    for (int i = 0; i < count; i++) y[i] += vy[i] * deltaTime;
+    for (int i = 0; i < count; i++) z[i] += vz[i] * deltaTime;
+    for (int i = 0; i < count; i++) life[i] -= deltaTime;
+    
+    // Pieces that hit the ground stop falling and skid
+    for (int i = 0; i < count; i++) {
+        float airborne = (y[i] < floor[i]) ? 0.0f : 1.0f;
+        vy[i] *= airborne;
+        y[i] = std::max(y[i], floor[i]);
+    }
+    for (int i = 0; i < count; i++) {
+        float skid = (y[i] <= floor[i]) ? 0.9f : 1.0f;
+        vx[i] *= skid;
+        vz[i] *= skid;
+    }
+    
+    for (int i = 0; i < pool.count; ) {
+        if (life[i] > 0.0f) {
+            i++;
+            continue;
+        }
+        int last = --pool.count;
+        x[i] = x[last]; y[i] = y[last]; z[i] = z[last];
+        vx[i] = vx[last]; vy[i] = vy[last]; vz[i] = vz[last];
+        life[i] = life[last];
+        pool.floor[i] = pool.floor[last];
+        pool.color[i] = pool.color[last];
+    }
+}
+
+// Camera-facing quads fading out with age, all in one immediate-mode batch.
+// Returns the draw calls issued.
+int DrawDebris(const DebrisPool& pool, Camera3D camera) {
+    if (pool.count == 0) return 0;
+    Matrix view = GetCameraMatrix(camera);
+    float h = pool.size/2;
+    Vector3 right = { view.m0 * h, view.m4 * h, view.m8 * h };
+    Vector3 up = { view.m1 * h, view.m5 * h, view.m9 * h };
+    
+    const int chunk = 1024;  // Quads per batch check
+    for (int start = 0; start < pool.count; start += chunk) {
+        int end = std::min(start + chunk, pool.count);
+        rlCheckRenderBatchLimit((end - start) * 4);
+        rlBegin(RL_QUADS);
+        for (int i = start; i < end; i++) {
+            Color c = pool.color[i];
+            rlColor4ub(c.r, c.g, c.b, (unsigned char)(255 * Clamp(pool.life[i] / (pool.lifetime * 0.5f), 0.0f, 1.0f)));
+            float x = pool.x[i], y = pool.y[i], z = pool.z[i];
+            rlVertex3f(x - right.x - up.x, y - right.y - up.y, z - right.z - up.z);
+            rlVertex3f(x + right.x - up.x, y + right.y - up.y, z + right.z - up.z);
+            rlVertex3f(x + right.x + up.x, y + right.y + up.y, z + right.z + up.z);
+            rlVertex3f(x - right.x + up.x, y - right.y + up.y, z - right.z + up.z);
+        }
+        rlEnd();
+    }
+    return 1;
+}
+
+// Render snapshot: everything drawing reads, copied out of the world after
+// each simulation step. Dynamic blocks come first, then the static blocks
+// the camera can see.
+struct RenderSnapshot {
+    std::vector<RenderBlock> blocks;
+    DebrisPool debris;
+    Camera3D camera;
+    Vector3 playerPosition;
+    float kickCooldown;
+    int targetBlock;               // Block under the crosshair, or -1
+    Vector3 targetCenter;
+    size_t blockCount;             // Dynamic and static blocks in the world
+    long long stats[STAT_COUNT];   // Gauges, and counter totals since the simulation started
+    PhaseTiming phases[PHASE_COUNT];
+};
+
+// Copies the live particles only
+void CopyDebris(DebrisPool& to, const DebrisPool& from) {
+    int count = from.count;
+    std::copy(from.x.begin(), from.x.begin() + count, to.x.begin());
+    std::copy(from.y.begin(), from.y.begin() + count, to.y.begin());
+    std::copy(from.z.begin(), from.z.begin() + count, to.z.begin());
+    std::copy(from.life.begin(), from.life.begin() + count, to.life.begin());
+    std::copy(from.color.begin(), from.color.begin() + count, to.color.begin());
+    to.count = count;
+    to.lifetime = from.lifetime;
+    to.size = from.size;
+}
+
+void CaptureRenderSnapshot(RenderSnapshot& snapshot, const std::vector<Block>& blocks, const StaticWorld& world, 
+                           const DebrisPool& debris, Camera3D camera, float drawDistance) {
+    snapshot.blocks.clear();
+    for (const Block& block : blocks) {
+        snapshot.blocks.push_back((RenderBlock){ block.position, block.color, block.health / block.maxHealth, block.isStatic });
+    }
+    ForEachVisibleStaticBlock(world, camera, drawDistance, [&](const StaticBlock& block) {
+        snapshot.blocks.push_back((RenderBlock){ GetBlockCenter(block), world.palette[block.palette], 1.0f, true });
+    });
+    CopyDebris(snapshot.debris, debris);
+    snapshot.camera = camera;
+    snapshot.blockCount = blocks.size() + world.blockCount;
+}
+
+// Returns the draw calls issued
+int DrawRenderBlocks(const std::vector<RenderBlock>& blocks, Vector3 blockSize) {
+    for (const RenderBlock& block : blocks) {
+        DrawCube(block.position, blockSize.x, blockSize.y, blockSize.z, block.isStatic ? Fade(block.color, 0.7f) : block.color);
+        DrawCubeWires(block.position, blockSize.x, blockSize.y, blockSize.z, block.isStatic ? GRAY : BLACK);
+    }
+    return (int)blocks.size() * 2;
+}
+
+// Triple buffer: the simulation fills the back slot and swaps it with the
+// middle one, the renderer swaps the middle one with its front slot. Each
+// swap is one atomic exchange, so neither side ever waits for the other.
+#define SNAPSHOT_FRESH 4  // Set on the middle slot until the renderer takes it
+
+struct SnapshotBuffer {
+    RenderSnapshot slots[3];
+    std::atomic<int> middle;  // Slot index, plus SNAPSHOT_FRESH
+    int back;                 // Owned by the simulation
+    int front;                // Owned by the renderer
+};
+
+void InitSnapshotBuffer(SnapshotBuffer& buffer) {
+    for (int i = 0; i < 3; i++) {
+        RenderSnapshot& snapshot = buffer.slots[i];
+        InitDebrisPool(snapshot.debris);
+        snapshot.camera = (Camera3D){ 0 };
+        snapshot.playerPosition = (Vector3){ 0.0f, 0.0f, 0.0f };
+        snapshot.kickCooldown = 0.0f;
+        snapshot.targetBlock = -1;
+        snapshot.targetCenter = (Vector3){ 0.0f, 0.0f, 0.0f };
+        snapshot.blockCount = 0;
+        for (int s = 0; s < STAT_COUNT; s++) snapshot.stats[s] = 0;
+        for (int p = 0; p < PHASE_COUNT; p++) snapshot.phases[p] = (PhaseTiming){ 0.0f, 0.0f };
+    }
+    buffer.back = 0;
+    buffer.middle.store(1);
+    buffer.front = 2;
+}
+
+void PublishSnapshot(SnapshotBuffer& buffer) {
+    buffer.back = buffer.middle.exchange(buffer.back | SNAPSHOT_FRESH, std::memory_order_acq_rel) & 3;
+}
+
+// Takes the newest published snapshot; false keeps the current front slot
+bool AcquireSnapshot(SnapshotBuffer& buffer) {
+    if (!(buffer.middle.load(std::memory_order_relaxed) & SNAPSHOT_FRESH)) return false;
+    buffer.front = buffer.middle.exchange(buffer.front, std::memory_order_acq_rel) & 3;
+    return true;
+}
+
+// Single-producer, single-consumer ring carrying frame input to the simulation
+#define INPUT_QUEUE_SIZE 2   // Power of two; later frames are merged until there's room
+#define SIMULATION_MAX_STEP (1.0f / 30.0f)  // Longest step the solver is given
+#define SIMULATION_MAX_SUBSTEPS 4           // Time beyond this many steps is dropped
+
+struct InputQueue {
+    FrameInput frames[INPUT_QUEUE_SIZE];
+    std::atomic<unsigned int> head;  // Next frame to read, advanced by the simulation
+    std::atomic<unsigned int> tail;  // Next frame to write, advanced by the main thread
+};
+
+bool PushFrameInput(InputQueue& queue, const FrameInput& input) {
+    unsigned int tail = queue.tail.load(std::memory_order_relaxed);
+    if (tail - queue.head.load(std::memory_order_acquire) == INPUT_QUEUE_SIZE) return false;
+    queue.frames[tail & (INPUT_QUEUE_SIZE - 1)] = input;
+    queue.tail.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+bool PopFrameInput(InputQueue& queue, FrameInput& input) {
+    unsigned int head = queue.head.load(std::memory_order_relaxed);
+    if (head == queue.tail.load(std::memory_order_acquire)) return false;
+    input = queue.frames[head & (INPUT_QUEUE_SIZE - 1)];
+    queue.head.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+// Folds a frame into one still waiting for room in the queue: presses and
+// motion add up, held keys and buttons take the newer state
+void MergeFrameInput(FrameInput& into, const FrameInput& next) {
+    const unsigned int heldButtons = 0x7;
+    into.deltaTime += next.deltaTime;
+    into.keysDown = next.keysDown;
+    into.keysPressed |= next.keysPressed;
+    into.mouseButtons = (next.mouseButtons & heldButtons) | ((into.mouseButtons | next.mouseButtons) & ~heldButtons);
+    into.mousePosition = next.mousePosition;
+    into.mouseDelta = Vector2Add(into.mouseDelta, next.mouseDelta);
+    into.mouseWheel += next.mouseWheel;
+}
+
+// Splits a frame, merged or not, into steps no longer than SIMULATION_MAX_STEP.
+// Presses and motion go with the first step. A simulation that fell further
+// behind than SIMULATION_MAX_SUBSTEPS steps loses the extra time rather than
+// falling further behind.
+int SplitFrameInput(const FrameInput& input, FrameInput steps[SIMULATION_MAX_SUBSTEPS]) {
+    const unsigned int heldButtons = 0x7;
+    int count = (int)ceilf(input.deltaTime / SIMULATION_MAX_STEP);
+    count = std::max(1, std::min(count, SIMULATION_MAX_SUBSTEPS));
+    float stepTime = fminf(input.deltaTime / count, SIMULATION_MAX_STEP);
+    for (int i = 0; i < count; i++) {
+        steps[i] = input;
+        steps[i].deltaTime = stepTime;
+        if (i == 0) continue;
+        steps[i].keysPressed = 0;
+        steps[i].mouseButtons &= heldButtons;
+        steps[i].mouseDelta = (Vector2){ 0.0f, 0.0f };
+        steps[i].mouseWheel = 0.0f;
+    }
+    return count;
+}
+
+// Simulation thread: plays each queued frame of input, split into bounded
+// steps, and publishes a snapshot after each frame. The main thread parks it before touching the world
+// itself (editor, pause menu) and only waits at those mode switches.
+enum SimulationState {
+    SIM_RUNNING,
+    SIM_PARK_REQUESTED,
+    SIM_PARKED,
+    SIM_QUIT
+};
+
+struct SimulationThread {
+    std::thread thread;
+    std::atomic<int> state;
+    InputQueue inputs;
+    SnapshotBuffer snapshots;
+    FrameInput pending;  // Main thread: input merged while the queue was full
+    bool hasPending;
+    std::atomic<bool> capturing;    // Main thread asks the simulation to record trace events
+    long long counted[STAT_COUNT];  // Simulation: counter totals published so far
+    long long merged[STAT_COUNT];   // Main thread: counter totals already merged
+};
+
+void InitSimulationThread(SimulationThread& sim) {
+    sim.state.store(SIM_PARKED);
+    sim.inputs.head.store(0);
+    sim.inputs.tail.store(0);
+    InitSnapshotBuffer(sim.snapshots);
+    sim.hasPending = false;
+    sim.capturing.store(false);
+    for (int i = 0; i < STAT_COUNT; i++) sim.counted[i] = sim.merged[i] = 0;
+}
+
+template <typename Step>
+void RunSimulation(SimulationThread& sim, Step step) {
+    for (;;) {
+        int state = sim.state.load(std::memory_order_acquire);
+        if (state == SIM_QUIT) return;
+        
+        // Queued input is still played before parking
+        FrameInput input;
+        if (state != SIM_PARKED && PopFrameInput(sim.inputs, input)) {
+            step(input);
+        } else if (state == SIM_PARK_REQUESTED) {
+            sim.state.store(SIM_PARKED, std::memory_order_release);
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));  // Waiting for input
+        }
+    }
+}
+
+// Hands input to the simulation without ever blocking the main thread
+void QueueSimulationInput(SimulationThread& sim, const FrameInput& input) {
+    if (sim.hasPending) {
+        MergeFrameInput(sim.pending, input);
+    } else {
+        sim.pending = input;
+        sim.hasPending = true;
+    }
+    if (PushFrameInput(sim.inputs, sim.pending)) sim.hasPending = false;
+}
+
+void ResumeSimulation(SimulationThread& sim) {
+    if (sim.state.load(std::memory_order_relaxed) == SIM_PARKED) sim.state.store(SIM_RUNNING, std::memory_order_release);
+}
+
+// Returns once the simulation has played its queued input and stopped
+void ParkSimulation(SimulationThread& sim) {
+    if (sim.state.load(std::memory_order_relaxed) != SIM_RUNNING) return;
+    while (sim.hasPending) {
+        if (PushFrameInput(sim.inputs, sim.pending)) sim.hasPending = false;
+        else std::this_thread::yield();
+    }
+    sim.state.store(SIM_PARK_REQUESTED, std::memory_order_release);
+    while (sim.state.load(std::memory_order_acquire) != SIM_PARKED) std::this_thread::yield();
+    
+    // The world may change before the next step, so drop the unread snapshot
+    sim.snapshots.middle.store(sim.snapshots.middle.load(std::memory_order_relaxed) & 3, std::memory_order_relaxed);
+}
+
+// Moves the simulation's trace events into the main profiler's capture. The
+// simulation is parked meanwhile, since it owns its profiler while running.
+void CollectSimulationTrace(SimulationThread& sim, FrameProfiler& profiler, FrameProfiler& simulationProfiler) {
+    bool running = sim.state.load(std::memory_order_relaxed) == SIM_RUNNING;
+    ParkSimulation(sim);
+    profiler.trace.insert(profiler.trace.end(), simulationProfiler.trace.begin(), simulationProfiler.trace.end());
+    simulationProfiler.trace.clear();
+    if (running) ResumeSimulation(sim);
+}
+
+void StopSimulation(SimulationThread& sim) {
+    if (!sim.thread.joinable()) return;
+    ParkSimulation(sim);
+    sim.state.store(SIM_QUIT, std::memory_order_release);
+    sim.thread.join();
+}
+
+// Folds a fresh snapshot's step counters and phase timings into this frame.
+// Counters arrive as running totals, so steps whose snapshot was overwritten
+// before the main thread read it still count: `merged` holds the totals
+// already added.
+void MergeSimulationTelemetry(FrameProfiler& profiler, FrameStats& stats, long long merged[STAT_COUNT], const RenderSnapshot& snapshot) {
+    for (int i = 0; i < STAT_COUNT; i++) {
+        // Gauges the simulation doesn't own are set again when the frame closes
+        if (statInfo[i].isGauge) {
+            stats.values[i] = snapshot.stats[i];
+        } else {
+            stats.values[i] += snapshot.stats[i] - merged[i];
+            merged[i] = snapshot.stats[i];
+        }
+    }
+    for (int p = 0; p < PHASE_COUNT; p++) {
+        if (snapshot.phases[p].duration == 0.0f) continue;
+        if (profiler.current[p].duration == 0.0f) profiler.current[p].start = snapshot.phases[p].start;
+        profiler.current[p].duration += snapshot.phases[p].duration;
+    }
+}
+
+// Editor tools
+enum EditTool {
+    TOOL_BRUSH,
+    TOOL_FILL_RECT,
+    TOOL_FILL_VOLUME
+};
+
+// Fills a grid-aligned region in one batch: `steps` counts whole blocks
+// from the `block` template position, signed per axis. Slots occupied by a
+// dynamic or a static block are skipped. Returns the number of blocks added
+// at the end of the array.
+int FillBlockRegion(std::vector<Block>& blocks, BlockGrid& grid, const StaticWorld& world, Block block, const short steps[3], Vector3 blockSize) {
+    int countX = abs(steps[0]) + 1, countY = abs(steps[1]) + 1, countZ = abs(steps[2]) + 1;
+    Vector3 stride = {
+        steps[0] < 0 ? -blockSize.x : blockSize.x,
+        steps[1] < 0 ? -blockSize.y : blockSize.y,
+        steps[2] < 0 ? -blockSize.z : blockSize.z
+    };
+    size_t total = (size_t)countX * countY * countZ;
+    size_t first = blocks.size();
+    grid.generation++;
+    
+    // Reserve once so the batch never reallocates mid-fill
+    blocks.reserve(first + total);
+    grid.next.reserve(first + total);
+    grid.blockCell.reserve(first + total);
+    ReserveCells(grid, grid.cellCount + total);
+    
+    Vector3 corner = block.position;
+    for (int x = 0; x < countX; x++) {
+        for (int y = 0; y < countY; y++) {
+            for (int z = 0; z < countZ; z++) {
+                block.position = (Vector3){ 
+                    corner.x + stride.x * x, 
+                    corner.y + stride.y * y, 
+                    corner.z + stride.z * z 
+                };
+                if (IsPointInStaticBlock(world, block.position)) continue;
+                
+                // One table probe both checks the slot and links the new block
+                long long key = GetCellKeyAt(grid, block.position);
+                int& head = FindOrAddCell(grid, key);
+                bool occupied = false;
+                for (int i = head; i >= 0 && !occupied; i = grid.next[i]) {
+                    occupied = Vector3Distance(blocks[i].position, block.position) < 0.1f;
+                }
+                if (occupied) continue;
+                
+                grid.next.push_back(head);
+                grid.blockCell.push_back(key);
+                head = (int)blocks.size();
+                blocks.push_back(block);
+            }
+        }
+    }
+    return (int)(blocks.size() - first);
+}
+
+// Whole-block steps from a drag start to the hovered slot, `layers` blocks tall
+void GetFillSteps(Vector3 start, Vector3 end, int layers, Vector3 blockSize, short steps[3]) {
+    steps[0] = (short)Clamp(roundf((end.x - start.x) / blockSize.x), -1000.0f, 1000.0f);
+    steps[1] = (short)(layers - 1);
+    steps[2] = (short)Clamp(roundf((end.z - start.z) / blockSize.z), -1000.0f, 1000.0f);
+}
+
+BoundingBox GetFillBounds(Vector3 start, const short steps[3], Vector3 blockSize) {
+    Vector3 end = { 
+        start.x + steps[0] * blockSize.x, 
+        start.y + steps[1] * blockSize.y, 
+        start.z + steps[2] * blockSize.z 
+    };
+    Vector3 half = Vector3Scale(blockSize, 0.5f);
+    return (BoundingBox){
+        Vector3Subtract(Vector3Min(start, end), half),
+        Vector3Add(Vector3Max(start, end), half)
+    };
+}
+
+// Returns the indices of all blocks centred inside the box, highest index first
+template <typename T>
+void CollectBlocksInRegion(const std::vector<T>& blocks, const BlockGrid& grid, 
+                           Vector3 min, Vector3 max, std::vector<int>& result) {
+    result.clear();
+    ForEachBlockInCells(grid, min, max, [&](int i) {
+        Vector3 p = GetBlockCenter(blocks[i]);
+        if (p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y && p.z >= min.z && p.z <= max.z) {
+            result.push_back(i);
+        }
+    });
+    // Descending order keeps swap-removal from moving a pending block
+    std::sort(result.begin(), result.end(), [](int a, int b) { return a > b; });
+}
+
+// Editor undo/redo: a ring buffer of small per-block deltas
+enum EditOpType {
+    EDIT_ADD,
+    EDIT_REMOVE,
+    EDIT_TOGGLE_STATIC,
+    EDIT_FILL
+};
+
+struct EditOp {
+    EditOpType type;
+    int index;          // Block slot touched by the op, or count added by a fill
+    bool groupStart;    // First op of an undo entry (a click or a whole brush stroke)
+    short steps[3];     // Fill extent in blocks from the template position
+    Block block;        // Added or removed block, the state before a toggle, or the fill template.
+                        // Static blocks are found by its position instead of the index.
+};
+
+struct EditHistory {
+    std::vector<EditOp> ops;  // Ring storage, sized once from the memory budget
+    size_t oldest;            // Ring slot of the oldest stored op
+    size_t count;             // Stored ops, including undone ones kept for redo
+    size_t applied;           // Ops currently applied to the world
+    bool groupOpen;
+    bool groupOverflowed;     // Open stroke outgrew the buffer and is no longer recorded
+    size_t groupOps;
+};
+
+void InitEditHistory(EditHistory& history, size_t memoryBudget) {
+    history.ops.assign(memoryBudget / sizeof(EditOp) > 0 ? memoryBudget / sizeof(EditOp) : 1, EditOp{});
+    history.oldest = history.count = history.applied = 0;
+    history.groupOpen = history.groupOverflowed = false;
+    history.groupOps = 0;
+}
+
+void ClearEditHistory(EditHistory& history) {
+    history.oldest = history.count = history.applied = 0;
+    history.groupOps = 0;
+}
+
+void BeginEditGroup(EditHistory& history) {
+    history.groupOpen = true;
+    history.groupOverflowed = false;
+    history.groupOps = 0;
+}
+
+void EndEditGroup(EditHistory& history) {
+    history.groupOpen = false;
+    history.groupOverflowed = false;
+}
+
+EditOp* RecordEditOp(EditHistory& history, EditOpType type, int index, Block block) {
+    if (history.groupOverflowed) return NULL;
+    
+    size_t capacity = history.ops.size();
+    history.count = history.applied; // A new edit discards the redo tail
+    
+    if (history.count == capacity) {
+        // A stroke larger than the whole buffer can't be undone
+        if (history.groupOpen && history.groupOps == history.count) {
+            ClearEditHistory(history);
+            history.groupOverflowed = true;
+            return NULL;
+        }
+        // Evict the oldest whole entry
+        do {
+            history.oldest = (history.oldest + 1) % capacity;
+            history.count--;
+        } while (history.count > 0 && !history.ops[history.oldest].groupStart);
+        history.applied = history.count;
+    }
+    
+    EditOp& op = history.ops[(history.oldest + history.count) % capacity];
+    op.type = type;
+    op.index = index;
+    op.groupStart = !history.groupOpen || history.groupOps == 0;
+    op.steps[0] = op.steps[1] = op.steps[2] = 0;
+    op.block = block;
+    
+    history.count++;
+    history.applied = history.count;
+    if (history.groupOpen) history.groupOps++;
+    return &op;
+}
+
+void ApplyEditOp(const EditOp& op, std::vector<Block>& blocks, BlockGrid& grid, StaticWorld& world, Vector3 blockSize) {
+    switch (op.type) {
+        case EDIT_ADD:
+            if (op.block.isStatic) AddStaticBlock(world, PackStaticBlock(world, op.block));
+            else AddBlock(blocks, grid, op.block);
+            break;
+        case EDIT_REMOVE:
+            if (op.block.isStatic) RemoveStaticBlock(world, op.block.position);
+            else RemoveBlock(blocks, grid, op.index);
+            break;
+        case EDIT_TOGGLE_STATIC: ToggleStoredBlock(blocks, grid, world, op.index, op.block); break;
+        case EDIT_FILL: FillBlockRegion(blocks, grid, world, op.block, op.steps, blockSize); break;
+    }
+}
+
+void RevertEditOp(const EditOp& op, std::vector<Block>& blocks, BlockGrid& grid, StaticWorld& world) {
+    switch (op.type) {
+        case EDIT_ADD:
+            if (op.block.isStatic) RemoveStaticBlock(world, op.block.position);
+            else RemoveBlock(blocks, grid, blocks.size() - 1);
+            break;
+        case EDIT_REMOVE:
+            if (op.block.isStatic) AddStaticBlock(world, PackStaticBlock(world, op.block));
+            else RestoreBlock(blocks, grid, op.index, op.block);
+            break;
+        case EDIT_TOGGLE_STATIC:
+            // A block made dynamic was appended; one made static is found by position
+            if (op.block.isStatic) {
+                RemoveBlock(blocks, grid, blocks.size() - 1);
+                AddStaticBlock(world, PackStaticBlock(world, op.block));
+            } else {
+                RemoveStaticBlock(world, op.block.position);
+                RestoreBlock(blocks, grid, op.index, op.block);
+            }
+            break;
+        case EDIT_FILL:
+            // A fill appends its blocks, so undo pops them
+            for (int i = 0; i < op.index; i++) {
+                RemoveBlock(blocks, grid, blocks.size() - 1);
+            }
+            break;
+    }
+}
+
+bool UndoEdit(EditHistory& history, std::vector<Block>& blocks, BlockGrid& grid, StaticWorld& world) {
+    if (history.applied == 0) return false;
+    
+    size_t capacity = history.ops.size();
+    const EditOp* op;
+    do {
+        history.applied--;
+        op = &history.ops[(history.oldest + history.applied) % capacity];
+        RevertEditOp(*op, blocks, grid, world);
+    } while (!op->groupStart);
+    return true;
+}
+
+bool RedoEdit(EditHistory& history, std::vector<Block>& blocks, BlockGrid& grid, StaticWorld& world, Vector3 blockSize) {
+    if (history.applied == history.count) return false;
+    
+    size_t capacity = history.ops.size();
+    do {
+        ApplyEditOp(history.ops[(history.oldest + history.applied) % capacity], blocks, grid, world, blockSize);
+        history.applied++;
+    } while (history.applied < history.count &&
+             !history.ops[(history.oldest + history.applied) % capacity].groupStart);
+    return true;
+}
+
+// Benchmark scenes: noise terrain, lots of hollow buildings and a field of
+// loose dynamic blocks. Every block is derived from the seed and its own
+// coordinates, so tiles can be generated on any thread in any order and a
+// seed always rebuilds the same world.
+#define SCENE_LOT 16        // Edge of a city lot, in blocks
+#define SCENE_CHUNK 4096    // Dynamic blocks per generation task
+
+struct SceneConfig {
+    unsigned int seed;
+    int size;               // Edge of the square scene, in blocks
+    int terrainHeight;      // Tallest terrain column, in blocks
+    float buildingChance;   // Per lot
+    int dynamicBlocks;
+};
+
+struct SceneBuilding {
+    int x, z;               // Corner, in blocks
+    int width, depth;
+    int height;             // Storeys of wall under the roof
+};
+
+int GetSceneOrigin(const SceneConfig& config) {
+    return -config.size / 2;
+}
+
+// City lots get a building on one flat ground layer; the lot at the origin
+// never does, so the player spawns in the open
+bool GetSceneBuilding(const SceneConfig& config, int lotX, int lotZ, SceneBuilding* building) {
+    int x = GetSceneOrigin(config) + lotX * SCENE_LOT, z = GetSceneOrigin(config) + lotZ * SCENE_LOT;
+    if (x <= 0 && x + SCENE_LOT > 0 && z <= 0 && z + SCENE_LOT > 0) return false;
+    if (GetNoiseRandom(config.seed, lotX, -1, lotZ) >= config.buildingChance) return false;
+    
+    unsigned int h = HashNoise(config.seed, lotX, -2, lotZ);
+    building->width = 5 + h % (SCENE_LOT - 6);
+    building->depth = 5 + (h >> 8) % (SCENE_LOT - 6);
+    building->height = 3 + (h >> 16) % 10;
+    building->x = x + 1 + (h >> 24) % (SCENE_LOT - 1 - building->width);
+    building->z = z + 1 + (h >> 28) % (SCENE_LOT - 1 - building->depth);
+    return true;
+}
+
+int GetSceneColumnHeight(const SceneConfig& config, int x, int z, bool cityLot) {
+    if (cityLot) return 1;
+    return 1 + (int)(GetValueNoise(config.seed, x, z) * (config.terrainHeight - 1));
+}
+
+// Levels taken at a column, terrain and roofs included
+int GetSceneSurface(const SceneConfig& config, int x, int z) {
+    int lotX = (x - GetSceneOrigin(config)) / SCENE_LOT, lotZ = (z - GetSceneOrigin(config)) / SCENE_LOT;
+    SceneBuilding building;
+    if (!GetSceneBuilding(config, lotX, lotZ, &building)) return GetSceneColumnHeight(config, x, z, false);
+    bool inside = x >= building.x && x < building.x + building.width && z >= building.z && z < building.z + building.depth;
+    return inside ? building.height + 2 : 1;
+}
+
+StaticBlock GetSceneBlock(int x, int level, int z, Vector3 blockSize, unsigned char palette) {
+    return (StaticBlock){
+        (short)(x * blockSize.x * 2.0f),
+        (short)((blockSize.y/2 + level * blockSize.y) * 2.0f),
+        (short)(z * blockSize.z * 2.0f),
+        palette
+    };
+}
+
+enum SceneColor {
+    SCENE_GRASS,
+    SCENE_DIRT,
+    SCENE_WALL,
+    SCENE_ROOF,
+    SCENE_COLOR_COUNT
+};
+
+// Static blocks of one lot: solid terrain columns, or a ground layer under a
+// hollow building with a doorway and a roof
+void GenerateSceneLot(const SceneConfig& config, int lotX, int lotZ, Vector3 blockSize, 
+                      const unsigned char palette[SCENE_COLOR_COUNT], std::vector<StaticBlock>& out) {
+    SceneBuilding building;
+    bool cityLot = GetSceneBuilding(config, lotX, lotZ, &building);
+    int originX = GetSceneOrigin(config) + lotX * SCENE_LOT, originZ = GetSceneOrigin(config) + lotZ * SCENE_LOT;
+    int endX = std::min(originX + SCENE_LOT, GetSceneOrigin(config) + config.size);
+    int endZ = std::min(originZ + SCENE_LOT, GetSceneOrigin(config) + config.size);
+    
+    for (int x = originX; x < endX; x++) {
+        for (int z = originZ; z < endZ; z++) {
+            int height = GetSceneColumnHeight(config, x, z, cityLot);
+            for (int level = 0; level < height; level++) {
+                unsigned char color = palette[level == height - 1 ? SCENE_GRASS : SCENE_DIRT];
+                out.push_back(GetSceneBlock(x, level, z, blockSize, color));
+            }
+        }
+    }
+    if (!cityLot) return;
+    
+    int doorX = building.x + building.width / 2;
+    for (int x = building.x; x < building.x + building.width; x++) {
+        for (int z = building.z; z < building.z + building.depth; z++) {
+            bool wall = x == building.x || x == building.x + building.width - 1 || 
+                        z == building.z || z == building.z + building.depth - 1;
+            for (int level = 1; wall && level <= building.height; level++) {
+                if (x == doorX && z == building.z && level <= 2) continue;
+                out.push_back(GetSceneBlock(x, level, z, blockSize, palette[SCENE_WALL]));
+            }
+            out.push_back(GetSceneBlock(x, building.height + 1, z, blockSize, palette[SCENE_ROOF]));
+        }
+    }
+}
+
+// Loose blocks dropped a few levels above the surface
+void GenerateSceneDynamicBlocks(const SceneConfig& config, int first, int count, Vector3 blockSize, std::vector<Block>& out) {
+    Color colors[] = { RED, BLUE, GREEN, YELLOW, PURPLE, ORANGE, PINK, LIME };
+    for (int n = first; n < first + count; n++) {
+        unsigned int h = HashNoise(config.seed, n, -3, 0);
+        int x = GetSceneOrigin(config) + (int)(h % config.size);
+        int z = GetSceneOrigin(config) + (int)(HashNoise(config.seed, n, -4, 0) % config.size);
+        int level = GetSceneSurface(config, x, z) + 1 + (h >> 24) % 6;
+        Vector3 position = { x * blockSize.x, blockSize.y/2 + level * blockSize.y, z * blockSize.z };
+        out.push_back((Block){ position, {0,0,0}, colors[(h >> 16) % 8], false, 100.0f, 100.0f });
+    }
+}
+
+// Runs work(item) for every item in [0, count) across the hardware threads
+template <typename Work>
+void ParallelFor(int count, Work work) {
+    int workers = std::min((int)std::max(1u, std::thread::hardware_concurrency()), count);
+    std::atomic<int> next(0);
+    auto run = [&]() {
+        for (int item = next.fetch_add(1); item < count; item = next.fetch_add(1)) work(item);
+    };
+    std::vector<std::thread> threads;
+    for (int t = 1; t < workers; t++) threads.emplace_back(run);
+    run();
+    for (std::thread& thread : threads) thread.join();
+}
+
+// Replaces the world with the scene. Tiles are generated in parallel and
+// merged in tile order, so the result doesn't depend on the thread count.
+// Returns the blocks added.
+int GenerateScene(const SceneConfig& config, std::vector<Block>& blocks, BlockGrid& grid, 
+                  StaticWorld& world, Vector3 blockSize) {
+    double start = GetTime();
+    blocks.clear();
+    InitStaticWorld(world);
+    
+    // Palette entries are fixed before any worker packs a block
+    unsigned char palette[SCENE_COLOR_COUNT] = {
+        GetPaletteIndex(world.palette, DARKGREEN),
+        GetPaletteIndex(world.palette, BROWN),
+        GetPaletteIndex(world.palette, LIGHTGRAY),
+        GetPaletteIndex(world.palette, DARKGRAY)
+    };
+    
+    int lots = (config.size + SCENE_LOT - 1) / SCENE_LOT;
+    std::vector<std::vector<StaticBlock>> lotBlocks(lots * lots);
+    ParallelFor(lots * lots, [&](int lot) {
+        GenerateSceneLot(config, lot % lots, lot / lots, blockSize, palette, lotBlocks[lot]);
+    });
+    
+    int chunks = (config.dynamicBlocks + SCENE_CHUNK - 1) / SCENE_CHUNK;
+    std::vector<std::vector<Block>> chunkBlocks(chunks);
+    ParallelFor(chunks, [&](int chunk) {
+        int first = chunk * SCENE_CHUNK;
+        GenerateSceneDynamicBlocks(config, first, std::min(SCENE_CHUNK, config.dynamicBlocks - first), blockSize, chunkBlocks[chunk]);
+    });
+    
+    int staticCount = 0;
+    for (const std::vector<StaticBlock>& lot : lotBlocks) {
+        for (const StaticBlock& block : lot) staticCount += AddStaticBlock(world, block) ? 1 : 0;
+    }
+    
+    // Blocks that landed in the same slot keep the first one
+    blocks.reserve(config.dynamicBlocks);
+    RebuildBlockGrid(grid, blocks);
+    ReserveCells(grid, config.dynamicBlocks);
+    for (const std::vector<Block>& chunk : chunkBlocks) {
+        for (const Block& block : chunk) {
+            if (FindBlockAt(blocks, grid, block.position) < 0) AddBlock(blocks, grid, block);
+        }
+    }
+    
+    TraceLog(LOG_INFO, "SCENE: Seed %u, %d static and %d dynamic blocks in %.2f s", 
+        config.seed, staticCount, (int)blocks.size(), GetTime() - start);
+    return staticCount + (int)blocks.size();
+}
+
+// Terrain stays flat this far from the origin, clear of the scene's buildings
+float GetSceneFlatRadius(const SceneConfig& config, Vector3 blockSize) {
+    return config.size * blockSize.x * 0.75f;
+}
+
+// Standing on the surface at the origin
+Vector3 GetSceneSpawn(const SceneConfig& config, Vector3 blockSize, float playerHeight) {
+    return (Vector3){ 0.0f, GetSceneSurface(config, 0, 0) * blockSize.y + playerHeight, 0.0f };
+}
+
+int main(int argc, char** argv) {
+    // Command line: --record <file> | --replay <file> [--headless]
+    //               --deterministic [--checksum-log <file>] [--checksum-golden <file>]
+    //               --stream-dir <directory> | --health-bar-distance <units>
+    //               --single-thread | --generate <seed> [--scene-size <blocks>]
+    const char* recordFileName = NULL;
+    const char* replayFileName = NULL;
+    const char* checksumLogName = NULL;
+    const char* checksumGoldenName = NULL;
+    const char* streamDirectory = NULL;
+    bool headless = false;
+    bool deterministic = false;
+    bool singleThread = false;  // Simulate and draw on the main thread
+    const char* sceneSeed = NULL;  // Start in a generated benchmark scene
+    SceneConfig sceneConfig = { 1, 256, 8, 0.35f, 0 };
+    float healthBarDistance = 40.0f;  // Damaged blocks farther away show no bar
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) recordFileName = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) replayFileName = argv[++i];
+        else if (strcmp(argv[i], "--headless") == 0) headless = true;
+        else if (strcmp(argv[i], "--deterministic") == 0) deterministic = true;
+        else if (strcmp(argv[i], "--single-thread") == 0) singleThread = true;
+        else if (strcmp(argv[i], "--generate") == 0 && i + 1 < argc) sceneSeed = argv[++i];
+        else if (strcmp(argv[i], "--scene-size") == 0 && i + 1 < argc) sceneConfig.size = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--checksum-log") == 0 && i + 1 < argc) checksumLogName = argv[++i];
+        else if (strcmp(argv[i], "--checksum-golden") == 0 && i + 1 < argc) checksumGoldenName = argv[++i];
+        else if (strcmp(argv[i], "--stream-dir") == 0 && i + 1 < argc) streamDirectory = argv[++i];
+        else if (strcmp(argv[i], "--health-bar-distance") == 0 && i + 1 < argc) healthBarDistance = (float)atof(argv[++i]);
+    }
+    if (sceneSeed) sceneConfig.seed = (unsigned int)strtoul(sceneSeed, NULL, 10);
+    sceneConfig.size = (int)Clamp((float)sceneConfig.size, (float)SCENE_LOT, 8192.0f);  // Packed positions are shorts
+    sceneConfig.dynamicBlocks = sceneConfig.size * sceneConfig.size / 64;
+    
+    // Checksums only make sense when steps are reproducible
+    StepChecksum checksum = { false, 1.0f / 60.0f, 0, NULL, NULL, false };
+    checksum.enabled = deterministic || checksumLogName || checksumGoldenName;
+    if (checksumLogName) checksum.log = fopen(checksumLogName, "w");
+    if (checksumGoldenName) checksum.golden = fopen(checksumGoldenName, "r");
+    if (checksumGoldenName && !checksum.golden) {
+        TraceLog(LOG_WARNING, "DETERMINISM: Failed to open golden file [%s]", checksumGoldenName);
+    }
+    
     // Window configuration
     const int screenWidth = 1280;
     const int screenHeight = 720;
     
+    // Headless replays keep a hidden window for screen-space math but never draw
+    if (headless && replayFileName) SetConfigFlags(FLAG_WINDOW_HIDDEN);
     InitWindow(screenWidth, screenHeight, "3D First Person Prototype");
     
+    // Input source: live, recorded to a file, or replayed from one
+    InputStream inputStream = { NULL, false, false, 0, 0 };
+    unsigned int randomSeed = (unsigned int)time(NULL);
+    if (replayFileName) {
+        if (OpenInputReplay(inputStream, replayFileName)) {
+            randomSeed = inputStream.seed;
+        } else {
+            TraceLog(LOG_WARNING, "REPLAY: Failed to open [%s], using live input", replayFileName);
+        }
+    } else if (recordFileName) {
+        if (!OpenInputRecording(inputStream, recordFileName, randomSeed)) {
+            TraceLog(LOG_WARNING, "REPLAY: Failed to create [%s]", recordFileName);
+        }
+    }
+    headless = headless && inputStream.replaying;
+    SetRandomSeed(randomSeed);
+    
     // First-person camera
     Camera3D fpCamera = { 0 };
     fpCamera.position = (Vector3){ 0.0f, 2.0f, 0.0f };
@@ -105,14 +4169,20 @@ int main() {
     Vector3 playerSize = { 0.8f, 2.0f, 0.8f };
     float playerSpeed = 5.0f;
     float jumpForce = 8.0f;
+    PlayerController playerController;
+    InitPlayerController(playerController, playerSize, 0.6f);  // Steps up ledges to 0.6 units
+    GroundProbe groundProbe;
+    InitGroundProbe(groundProbe, playerController.stepHeight);
     float gravity = 20.0f;
     bool isGrounded = false;
-    float groundLevel = 0.0f;
     float playerHeight = 2.0f;
     float pushForce = 3.0f;
     float kickForce = 15.0f;
     float kickRange = 3.0f;
     float kickCooldown = 0.0f;
+    float targetDistance = 50.0f;
+    int targetBlock = -1;  // Block under the crosshair, or -1
+    Vector3 targetCenter = { 0.0f, 0.0f, 0.0f };
     
     // Mouse sensitivity
     float mouseSensitivity = 0.003f;
@@ -123,246 +4193,520 @@ int main() {
     bool isPaused = false;
     GameMode currentMode = NORMAL_MODE;
     
+    // Profiling (F3 - overlay, F4 - start/stop Chrome trace capture)
+    FrameProfiler profiler;
+    InitFrameProfiler(profiler);
+    const char* traceFileName = "frame_trace.json";
+    
+    // Statistics (F5 - start/stop CSV telemetry)
+    FrameStats stats;
+    InitFrameStats(stats);
+    const char* statsFileName = "frame_stats.csv";
+    
     // World editing variables
     float editCameraSpeed = 15.0f;
     Vector3 editCameraPosition = editCamera.position;
     std::vector<Block> blocks;
     Vector3 blockSize = { 2.0f, 2.0f, 2.0f };
+    BlockGrid blockGrid;
+    blockGrid.cellSize = blockSize.x;
+    blockGrid.cellCount = 0;
+    blockGrid.generation = 0;
+    StaticWorld staticWorld;  // Static blocks live in a brick map, apart from the dynamic ones
+    InitStaticWorld(staticWorld);
+    float staticDrawDistance = 300.0f;
+    StaticStreamer streamer = { streamDirectory, 400.0f, {}, 0, {} };  // Off unless --stream-dir is given
+    EditHistory editHistory;
+    InitEditHistory(editHistory, 4 * 1024 * 1024); // 4 MB of undo deltas
+    
+    // Terrain: flat around the origin (or under a generated scene), hills beyond.
+    // The simulation queries its own height cache; drawing keeps the meshes.
+    TerrainShape terrainShape = { 7919u, 2.0f, 30.0f, 80.0f };
+    if (sceneSeed) terrainShape.flatRadius = GetSceneFlatRadius(sceneConfig, blockSize);
+    TerrainHeights terrain;
+    InitTerrainHeights(terrain, terrainShape);
+    TerrainRenderer terrainRenderer;
+    InitTerrainRenderer(terrainRenderer, terrainShape, 900.0f);
+    std::vector<float> terrainScratch;  // Heights of the chunk being meshed
+    GridRenderer groundGrid;
+    InitGridRenderer(groundGrid, 0.0f);
+    
+    // Editor tools
+    EditTool editTool = TOOL_BRUSH;
+    int fillLayers = 1;
+    bool isDragging = false;
+    bool dragErase = false;
+    Vector3 dragStart = { 0.0f, 0.0f, 0.0f };
+    std::vector<int> regionBlocks;
+    std::vector<StaticBlock> regionStaticBlocks;
+    
+    // Transient per-frame data lives in the arena
+    FrameArena frameArena;
+    InitFrameArena(frameArena, 1024 * 1024);
+    int editLayer = 0;
+    float editPickDistance = 500.0f;
+    bool strokeActive = false;
+    float strokeY = 0.0f;
+    int hoveredBlock = -1;                       // Block under the cursor, or -1
+    bool hoveredStatic = false;                  // hoveredBlock is a static block
+    Vector3 hoveredCenter = { 0.0f, 0.0f, 0.0f };
+    Vector3 snappedPos = { 0.0f, 1.0f, 0.0f };  // Where a new block would go
     
     // Physics & Damage
     float friction = 0.9f;
     float blockGravity = 20.0f;
     float damageThreshold = 3.0f;  // Minimum velocity to cause damage
+    float staticBreakSpeed = 10.0f;  // Impacts this fast break static blocks
     float damageMultiplier = 5.0f;
+    DamageBuffer damageBuffer;
+    InitDamageBuffer(damageBuffer, damageThreshold, damageMultiplier, staticBreakSpeed);
+    DebrisPool debris;
+    InitDebrisPool(debris);
+    int debrisPieces = 8;  // Per destroyed block
+    Vector2 healthBarSize = { 40.0f, 5.0f };
+    ContactSolver contactSolver;
+    InitContactSolver(contactSolver);
+    SupportGraph supportGraph;
+    InitSupportGraph(supportGraph);
+    CollapseSearch collapseSearch;
+    InitCollapseSearch(collapseSearch, 8192);
+    
+    if (sceneSeed) {
+        GenerateScene(sceneConfig, blocks, blockGrid, staticWorld, blockSize);
+        playerPosition = GetSceneSpawn(sceneConfig, blockSize, playerHeight);
+        fpCamera.position = playerPosition;
+        fpCamera.target = Vector3Add(playerPosition, (Vector3){ 0.0f, 0.0f, 1.0f });
+    } else {
+        // Add some initial blocks with health
+        blocks.push_back({ (Vector3){ -5.0f, 1.0f, 5.0f }, {0,0,0}, RED, false, 100.0f, 100.0f });
+        blocks.push_back({ (Vector3){ 5.0f, 1.0f, 5.0f }, {0,0,0}, BLUE, false, 100.0f, 100.0f });
+        blocks.push_back({ (Vector3){ 0.0f, 1.0f, 10.0f }, {0,0,0}, YELLOW, false, 100.0f, 100.0f });
+        blocks.push_back({ (Vector3){ 10.0f, 1.0f, -5.0f }, {0,0,0}, ORANGE, false, 100.0f, 100.0f });
+        RebuildBlockGrid(blockGrid, blocks);
+        
+        // Static - high health
+        AddStaticBlock(staticWorld, 
+            PackStaticBlock(staticWorld, { (Vector3){ -10.0f, 1.0f, -5.0f }, {0,0,0}, PURPLE, true, 1000.0f, 1000.0f }));
+        AddStaticBlock(staticWorld, 
+            PackStaticBlock(staticWorld, { (Vector3){ 0.0f, 0.5f, 3.0f }, {0,0,0}, BROWN, true, 1000.0f, 1000.0f }));
+    }
+    
+    // HUD text, laid out once and again only when it changes
+    HudText hudText;
+    InitHudText(hudText);
+    AddHudLabel(hudText, HUD_NORMAL, 10, 10, 20, DARKGRAY, "NORMAL MODE");
+    AddHudLabel(hudText, HUD_NORMAL, 10, 40, 20, DARKGRAY, "WASD - Move | SPACE - Jump | E - Kick | TAB - Pause");
+    AddHudLabel(hudText, HUD_NORMAL, 10, 70, 20, GREEN, "Kick blocks to damage them! Blocks break on hard impacts!");
+    int positionLabel = AddHudLabel(hudText, HUD_NORMAL, 10, 100, 20, DARKGRAY, "");
+    int kickLabel = AddHudLabel(hudText, HUD_NORMAL, 10, 130, 20, GREEN, "");
+    AddHudLabel(hudText, HUD_NORMAL, 10, 160, 18, GRAY, "F3 - Profiler | F4 - Record Trace | F5 - Record Stats CSV");
     
-    // Add some initial blocks with health
-    blocks.push_back({ (Vector3){ -5.0f, 1.0f, 5.0f }, {0,0,0}, RED, false, 100.0f, 100.0f });
-    blocks.push_back({ (Vector3){ 5.0f, 1.0f, 5.0f }, {0,0,0}, BLUE, false, 100.0f, 100.0f });
-    blocks.push_back({ (Vector3){ 0.0f, 1.0f, 10.0f }, {0,0,0}, YELLOW, false, 100.0f, 100.0f });
-    blocks.push_back({ (Vector3){ -10.0f, 1.0f, -5.0f }, {0,0,0}, PURPLE, true, 1000.0f, 1000.0f }); // Static - high health
-    blocks.push_back({ (Vector3){ 10.0f, 1.0f, -5.0f }, {0,0,0}, ORANGE, false, 100.0f, 100.0f });
-    blocks.push_back({ (Vector3){ 0.0f, 0.5f, 3.0f }, {0,0,0}, BROWN, true, 1000.0f, 1000.0f });
+    AddHudLabel(hudText, HUD_EDITOR, 10, 10, 25, ORANGE, "WORLD EDITING MODE (W/S Inverted)");
+    AddHudLabel(hudText, HUD_EDITOR, 10, 40, 20, DARKGRAY, "WASD - Move | LMB - Add | RMB - Remove | MMB - Toggle Static");
+    int blockCountLabel = AddHudLabel(hudText, HUD_EDITOR, 10, 70, 20, DARKGRAY, "");
+    AddHudLabel(hudText, HUD_EDITOR, 10, 100, 18, GRAY, "Faded blocks are STATIC (only hard impacts break them)");
+    int historyLabel = AddHudLabel(hudText, HUD_EDITOR, 10, 130, 18, GRAY, "");
+    int toolLabel = AddHudLabel(hudText, HUD_EDITOR, 10, 160, 18, GRAY, "");
+    AddHudLabel(hudText, HUD_EDITOR, 10, 190, 18, GRAY, "G - Generate Benchmark Scene (replaces the world)");
+    
+    ProfilerLabels profilerLabels;
+    AddProfilerLabels(hudText, profilerLabels);
+    StatsLabels statsLabels;
+    AddStatsLabels(hudText, statsLabels);
+    int fpsLabel = AddHudLabel(hudText, HUD_FPS, 10, screenHeight - 30, 20, LIME, "");
+    
+    AddHudCaption(hudText, HUD_PAUSE, (Rectangle){ 0, 100, screenWidth, 60 }, 60, WHITE, "PAUSED");
+    AddHudCaption(hudText, HUD_PAUSE, (Rectangle){ 0, 570, screenWidth, 20 }, 20, LIGHTGRAY, "TAB - Resume");
+    
+    // Pause menu
+    UiMenu pauseMenu;
+    InitUiMenu(pauseMenu, screenWidth, screenHeight, HUD_PAUSE);
+    AddUiButton(pauseMenu, hudText, (Rectangle){ screenWidth/2 - 150, 220, 300, 60 }, "NORMAL MODE", DARKBLUE, BLUE, UI_NORMAL_MODE);
+    AddUiButton(pauseMenu, hudText, (Rectangle){ screenWidth/2 - 150, 300, 300, 60 }, "WORLD EDITING", DARKGREEN, GREEN, UI_EDIT_MODE);
+    AddUiButton(pauseMenu, hudText, (Rectangle){ screenWidth/2 - 150, 380, 300, 60 }, "CONTINUE", DARKPURPLE, PURPLE, UI_CONTINUE);
+    AddUiButton(pauseMenu, hudText, (Rectangle){ screenWidth/2 - 150, 460, 300, 60 }, "EXIT GAME", DARKGRAY, RED, UI_EXIT);
     
     DisableCursor();
-    SetTargetFPS(60);
+    SetTargetFPS(headless ? 0 : 60); // Headless replays fast-forward uncapped
     
-    while (!WindowShouldClose()) {
-        float deltaTime = GetFrameTime();
-        
+    bool exitRequested = false;
+    double runStart = GetTime();
+    
+    // One game step in normal mode: on the simulation thread, or inline when
+    // replaying, recording or checking determinism
+    auto simulateFrame = [&](const FrameInput& input, float deltaTime, FrameProfiler& profiler, 
+                             FrameStats& stats, FrameArena& frameArena) {
         // Update kick cooldown
         if (kickCooldown > 0) kickCooldown -= deltaTime;
         
-        // Toggle pause menu with TAB
-        if (IsKeyPressed(KEY_TAB)) {
-            isPaused = !isPaused;
-            if (isPaused) {
-                EnableCursor();
-            } else {
-                DisableCursor();
-            }
+        // Cached terrain heights follow the player
+        SetTerrainFocus(terrain, playerPosition);
+        
+        // First-person mode updates
+        BeginProfilePhase(profiler, PHASE_INPUT);
+        Vector2 mouseDelta = input.mouseDelta;
+        cameraYaw -= mouseDelta.x * mouseSensitivity;
+        cameraPitch -= mouseDelta.y * mouseSensitivity;
+        
+        // Clamp pitch
+        if (cameraPitch > 1.5f) cameraPitch = 1.5f;
+        if (cameraPitch < -1.5f) cameraPitch = -1.5f;
+        
+        // Calculate direction vectors
+        Vector3 forward = { sinf(cameraYaw), 0.0f, cosf(cameraYaw) };
+        Vector3 right = { cosf(cameraYaw), 0.0f, -sinf(cameraYaw) };
+        
+        // Movement input
+        Vector3 moveDirection = { 0.0f, 0.0f, 0.0f };
+        
+        if (IsInputKeyDown(input, KEY_W)) {
+            moveDirection = Vector3Add(moveDirection, forward);
+        }
+        if (IsInputKeyDown(input, KEY_S)) {
+            moveDirection = Vector3Subtract(moveDirection, forward);
+        }
+        if (IsInputKeyDown(input, KEY_A)) {
+            moveDirection = Vector3Add(moveDirection, right);
+        }
+        if (IsInputKeyDown(input, KEY_D)) {
+            moveDirection = Vector3Subtract(moveDirection, right);
         }
         
-        // Update based on mode and pause state
-        if (!isPaused) {
-            if (currentMode == NORMAL_MODE) {
-                // First-person mode updates
-                Vector2 mouseDelta = GetMouseDelta();
-                cameraYaw -= mouseDelta.x * mouseSensitivity;
-                cameraPitch -= mouseDelta.y * mouseSensitivity;
-                
-                // Clamp pitch
-                if (cameraPitch > 1.5f) cameraPitch = 1.5f;
-                if (cameraPitch < -1.5f) cameraPitch = -1.5f;
-                
-                // Calculate direction vectors
-                Vector3 forward = { sinf(cameraYaw), 0.0f, cosf(cameraYaw) };
-                Vector3 right = { cosf(cameraYaw), 0.0f, -sinf(cameraYaw) };
-                
-                // Movement input
-                Vector3 moveDirection = { 0.0f, 0.0f, 0.0f };
-                
-                if (IsKeyDown(KEY_W)) {
-                    moveDirection = Vector3Add(moveDirection, forward);
-                }
-                if (IsKeyDown(KEY_S)) {
-                    moveDirection = Vector3Subtract(moveDirection, forward);
-                }
-                if (IsKeyDown(KEY_A)) {
-                    moveDirection = Vector3Add(moveDirection, right);
-                }
-                if (IsKeyDown(KEY_D)) {
-                    moveDirection = Vector3Subtract(moveDirection, right);
-                }
-                
-                // Normalize movement
-                if (Vector3Length(moveDirection) > 0) {
-                    moveDirection = Vector3Normalize(moveDirection);
-                }
-                
-                // Apply movement
-                playerVelocity.x = moveDirection.x * playerSpeed;
-                playerVelocity.z = moveDirection.z * playerSpeed;
-                
-                // Jump
-                if (IsKeyPressed(KEY_SPACE) && isGrounded) {
-                    playerVelocity.y = jumpForce;
-                    isGrounded = false;
-                }
+        // Normalize movement
+        if (Vector3Length(moveDirection) > 0) {
+            moveDirection = Vector3Normalize(moveDirection);
+        }
+        
+        // Apply movement
+        playerVelocity.x = moveDirection.x * playerSpeed;
+        playerVelocity.z = moveDirection.z * playerSpeed;
+        
+        // Jump
+        if (IsInputKeyPressed(input, KEY_SPACE) && isGrounded) {
+            playerVelocity.y = jumpForce;
+            isGrounded = false;
+        }
+        EndProfilePhase(profiler, PHASE_INPUT);
+        
+        // KICK ABILITY (E key)
+        if (IsInputKeyPressed(input, KEY_E) && kickCooldown <= 0) {
+            ProfileScope scope(profiler, PHASE_KICK);
+            kickCooldown = 0.5f; // 0.5 second cooldown
+            
+            // Find blocks in kick range through the grid instead of scanning the world
+            Vector3 kickMin = { playerPosition.x - kickRange, playerPosition.y - playerHeight - kickRange, playerPosition.z - kickRange };
+            Vector3 kickMax = { playerPosition.x + kickRange, playerPosition.y + kickRange, playerPosition.z + kickRange };
+            ForEachBlockInCells(blockGrid, kickMin, kickMax, [&](int i) {
+                Block& block = blocks[i];
+                Vector3 toBlock = Vector3Subtract(block.position, playerPosition);
+                toBlock.y = 0; // Only horizontal distance
+                float distance = Vector3Length(toBlock);
                 
-                // KICK ABILITY (E key)
-                if (IsKeyPressed(KEY_E) && kickCooldown <= 0) {
-                    kickCooldown = 0.5f; // 0.5 second cooldown
+                if (distance <= kickRange && distance > 0) {
+                    // Check if block is in front of player
+                    Vector3 dirToBlock = Vector3Normalize(toBlock);
+                    float dot = forward.x * dirToBlock.x + forward.z * dirToBlock.z;
                     
-                    // Find blocks in kick range
-                    for (auto& block : blocks) {
-                        Vector3 toBlock = Vector3Subtract(block.position, playerPosition);
-                        toBlock.y = 0; // Only horizontal distance
-                        float distance = Vector3Length(toBlock);
+                    if (dot > 0.5f && !block.isStatic) { // In front
+                        // Line of sight: no other block may sit between the player and the target
+                        Vector3 toCenter = Vector3Subtract(block.position, playerPosition);
+                        Ray sight = { playerPosition, Vector3Normalize(toCenter) };
+                        BlockHit first = RaycastWorld(blocks, blockGrid, staticWorld, sight, Vector3Length(toCenter), blockSize);
+                        if (first.index >= 0 && (first.isStatic || first.index != i)) return;
                         
-                        if (distance <= kickRange && distance > 0) {
-                            // Check if block is in front of player
-                            Vector3 dirToBlock = Vector3Normalize(toBlock);
-                            float dot = forward.x * dirToBlock.x + forward.z * dirToBlock.z;
-                            
-                            if (dot > 0.5f && !block.isStatic) { // In front
-                                // Apply kick force
-                                block.velocity.x = dirToBlock.x * kickForce;
-                                block.velocity.z = dirToBlock.z * kickForce;
-                                block.velocity.y = kickForce * 0.5f; // Slight upward kick
-                            }
-                        }
+                        // Apply kick force
+                        WakeBlock(supportGraph, i);
+                        block.velocity.x = dirToBlock.x * kickForce;
+                        block.velocity.z = dirToBlock.z * kickForce;
+                        block.velocity.y = kickForce * 0.5f; // Slight upward kick
                     }
                 }
+            });
+        }
+        
+        BeginProfilePhase(profiler, PHASE_PLAYER);
+        
+        // Apply gravity; standing is found again every step
+        playerVelocity.y -= gravity * deltaTime;
+        bool wasGrounded = isGrounded;
+        
+        // Sweep the player through the blocks around the move
+        GatherPlayerObstacles(playerController, blocks, blockGrid, staticWorld, blockSize, 
+            GetPlayerSweepRegion(playerController, playerPosition, playerVelocity, deltaTime));
+        PlayerSlide slide = MovePlayer(playerController, playerPosition, playerVelocity, wasGrounded, deltaTime);
+        isGrounded = slide.grounded;
+        
+        // Push the dynamic blocks walked into
+        for (int p = 0; p < slide.pushedCount; p++) {
+            Block& block = blocks[slide.pushed[p]];
+            Vector3 pushDir = Vector3Subtract(block.position, playerPosition);
+            pushDir.y = 0;
+            
+            if (Vector3Length(pushDir) > 0) {
+                pushDir = Vector3Normalize(pushDir);
+                WakeBlock(supportGraph, slide.pushed[p]);
+                block.velocity.x = pushDir.x * pushForce;
+                block.velocity.z = pushDir.z * pushForce;
+            }
+        }
+        
+        // Ground collision against the terrain and the block tops under the
+        // feet, following either down small drops while walking
+        float terrainLevel = GetTerrainFootprintHeight(terrain, playerPosition, playerSize);
+        float blockLevel = ProbeGround(groundProbe, blocks, blockGrid, staticWorld, blockSize, playerPosition, playerSize);
+        float groundLevel = fmaxf(terrainLevel, blockLevel);
+        float aboveGround = playerPosition.y - playerHeight - groundLevel;
+        bool falling = playerVelocity.y <= 0.0f;
+        if (playerPosition.y - playerHeight <= terrainLevel || (falling && aboveGround <= 0.0f) || 
+            (wasGrounded && !isGrounded && falling && aboveGround < playerController.stepHeight)) {
+            playerPosition.y = groundLevel + playerHeight;
+            playerVelocity.y = 0.0f;
+            isGrounded = true;
+        }
+        
+        EndProfilePhase(profiler, PHASE_PLAYER);
+        
+        // Update blocks physics: forces first, positions after the contacts are solved
+        BeginProfilePhase(profiler, PHASE_INTEGRATE);
+        if (supportGraph.asleep.size() != blocks.size()) ResetSupportGraph(supportGraph, blocks.size());
+        for (size_t i = 0; i < blocks.size(); i++) {
+            // Sleeping blocks rest on their supports and need no forces
+            if (!blocks[i].isStatic && !supportGraph.asleep[i]) {
+                // Apply friction
+                blocks[i].velocity.x *= friction;
+                blocks[i].velocity.z *= friction;
                 
                 // Apply gravity
-                if (!isGrounded) {
-                    playerVelocity.y -= gravity * deltaTime;
-                }
-                
-                // Store old position
-                Vector3 oldPosition = playerPosition;
-                
-                // Update position
-                playerPosition = Vector3Add(playerPosition, 
-                    Vector3Scale(playerVelocity, deltaTime));
-                
-                // Get player bounding box
-                BoundingBox playerBox = GetPlayerBoundingBox(playerPosition, playerSize);
+                blocks[i].velocity.y -= blockGravity * deltaTime;
+            }
+        }
+        EndProfilePhase(profiler, PHASE_INTEGRATE);
+        
+        // Then build and solve contacts against blocks, static geometry and the ground
+        BeginProfilePhase(profiler, PHASE_COLLIDE);
+        CountStat(stats, STAT_PAIR_TESTS, 
+            BuildContacts(contactSolver, blocks, blockGrid, staticWorld, supportGraph, blockSize, terrain, deltaTime));
+        CountStat(stats, STAT_COLLISIONS, contactSolver.contacts.size());
+        WakeOnImpact(supportGraph, contactSolver);
+        CollectDamageEvents(damageBuffer, contactSolver);
+        CountStat(stats, STAT_DAMAGE_EVENTS, damageBuffer.events.size());
+        SolveContacts(contactSolver, blocks, deltaTime);
+        ResolveDamage(damageBuffer, blocks);
+        EndProfilePhase(profiler, PHASE_COLLIDE);
+        
+        BeginProfilePhase(profiler, PHASE_INTEGRATE);
+        long long activeBlocks = 0;
+        for (size_t i = 0; i < blocks.size(); i++) {
+            if (!blocks[i].isStatic) {
+                // Stop very slow blocks
+                if (fabs(blocks[i].velocity.x) < 0.01f) blocks[i].velocity.x = 0;
+                if (fabs(blocks[i].velocity.y) < 0.01f) blocks[i].velocity.y = 0;
+                if (fabs(blocks[i].velocity.z) < 0.01f) blocks[i].velocity.z = 0;
                 
-                // Check collisions with blocks
-                for (auto& block : blocks) {
-                    BoundingBox blockBox = GetBlockBoundingBox(block, blockSize);
-                    
-                    if (CheckCollisionBoxes(playerBox, blockBox)) {
-                        // Push block if not static
-                        if (!block.isStatic) {
-                            Vector3 pushDir = Vector3Subtract(block.position, playerPosition);
-                            pushDir.y = 0;
-                            
-                            if (Vector3Length(pushDir) > 0) {
-                                pushDir = Vector3Normalize(pushDir);
-                                block.velocity.x = pushDir.x * pushForce;
-                                block.velocity.z = pushDir.z * pushForce;
-                            }
-                        }
-                        
-                        // Resolve collision
-                        playerPosition = oldPosition;
-                        playerVelocity.x = 0;
-                        playerVelocity.z = 0;
-                    }
+                Vector3 v = blocks[i].velocity;
+                if (v.x != 0.0f || v.y != 0.0f || v.z != 0.0f) {
+                    blocks[i].position = Vector3Add(blocks[i].position, Vector3Scale(v, deltaTime));
+                    GridUpdateBlock(blockGrid, (int)i, blocks[i].position);
+                    activeBlocks++;
                 }
-                
-                // Ground collision
-                if (playerPosition.y <= groundLevel + playerHeight) {
-                    playerPosition.y = groundLevel + playerHeight;
-                    playerVelocity.y = 0.0f;
-                    isGrounded = true;
+            }
+        }
+        SetStat(stats, STAT_ACTIVE_BLOCKS, activeBlocks);
+        SetStat(stats, STAT_SLEEPING_BLOCKS, 
+            UpdateSupportGraph(supportGraph, contactSolver, blocks, frameArena, deltaTime));
+        EndProfilePhase(profiler, PHASE_INTEGRATE);
+        
+        // Remove destroyed blocks: only this step's victims can die, highest index first
+        BeginProfilePhase(profiler, PHASE_DESTROY);
+        int* destroyedBlocks = ArenaAllocArray<int>(frameArena, damageBuffer.victims.size());
+        int destroyedCount = 0;
+        for (int v = (int)damageBuffer.victims.size() - 1; v >= 0; v--) {
+            int i = damageBuffer.victims[v];
+            if (blocks[i].health <= 0) destroyedBlocks[destroyedCount++] = i;
+        }
+        SetStat(stats, STAT_DESTROY_QUEUE, destroyedCount);
+        for (int d = 0; d < destroyedCount; d++) {
+            const Block& destroyed = blocks[destroyedBlocks[d]];
+            SpawnDebris(debris, terrain, destroyed.position, blockSize, destroyed.color, debrisPieces);
+            // Whatever rested on the block wakes up and falls
+            RemoveSupportNode(supportGraph, destroyedBlocks[d]);
+            RemoveBlock(blocks, blockGrid, destroyedBlocks[d]);
+        }
+        CountStat(stats, STAT_REMOVALS, destroyedCount);
+        
+        // Broken static blocks go last, since loose islands are appended as dynamic blocks
+        for (const StaticBlock& broken : damageBuffer.brokenStatic) {
+            // An earlier break may already have released it as part of an island
+            if (!RemoveStaticBlock(staticWorld, GetBlockCenter(broken))) continue;
+            WakeBlocksTouching(supportGraph, blocks, blockGrid, GetBlockCenter(broken), blockSize);
+            SpawnDebris(debris, terrain, GetBlockCenter(broken), blockSize, staticWorld.palette[broken.palette], debrisPieces);
+            CountStat(stats, STAT_REMOVALS);
+            CountStat(stats, STAT_COLLAPSED_BLOCKS, CollapseStaticIslands(collapseSearch, staticWorld, 
+                blocks, blockGrid, supportGraph, broken, blockSize, terrain));
+        }
+        UpdateDebris(debris, blockGravity, deltaTime);
+        SetStat(stats, STAT_DEBRIS, debris.count);
+        EndProfilePhase(profiler, PHASE_DESTROY);
+        
+        if (checksum.enabled && !CheckStepChecksum(checksum, HashWorldState(blocks, staticWorld))) {
+            exitRequested = true;
+        }
+        
+        // Update first-person camera
+        BeginProfilePhase(profiler, PHASE_CAMERA);
+        fpCamera.position = playerPosition;
+        fpCamera.target = (Vector3){
+            playerPosition.x + sinf(cameraYaw),
+            playerPosition.y + cameraPitch,
+            playerPosition.z + cosf(cameraYaw)
+        };
+        
+        // Crosshair target
+        Ray aim = { fpCamera.position, Vector3Normalize(Vector3Subtract(fpCamera.target, fpCamera.position)) };
+        BlockHit target = RaycastWorld(blocks, blockGrid, staticWorld, aim, targetDistance, blockSize);
+        targetBlock = target.index;
+        targetCenter = target.center;
+        
+        // Stream static regions around the player every 30 steps. Counted per
+        // step, not per frame: a frame split into substeps runs this repeatedly.
+        if (streamer.steps++ % 30 == 0) UpdateStaticStreaming(staticWorld, streamer, playerPosition);
+        EndProfilePhase(profiler, PHASE_CAMERA);
+    };
+    
+    // Render handoff: in normal mode the world belongs to the simulation thread
+    // and drawing reads its latest snapshot. Replays, recordings and
+    // determinism checks step inline so each step sees exactly one frame.
+    bool threaded = !singleThread && !inputStream.replaying && !inputStream.recording && !checksum.enabled;
+    SimulationThread simulation;
+    InitSimulationThread(simulation);
+    FrameArena simulationArena;
+    InitFrameArena(simulationArena, 1024 * 1024);
+    FrameProfiler simulationProfiler;
+    InitFrameProfiler(simulationProfiler);
+    simulationProfiler.traceThread = 2;
+    FrameStats simulationStats;
+    InitFrameStats(simulationStats);
+    
+    auto captureSnapshot = [&](RenderSnapshot& snapshot, Camera3D camera) {
+        CaptureRenderSnapshot(snapshot, blocks, staticWorld, debris, camera, staticDrawDistance);
+        snapshot.playerPosition = playerPosition;
+        snapshot.kickCooldown = kickCooldown;
+        snapshot.targetBlock = targetBlock;
+        snapshot.targetCenter = targetCenter;
+    };
+    captureSnapshot(simulation.snapshots.slots[simulation.snapshots.front], fpCamera);
+    
+    if (threaded) {
+        simulation.thread = std::thread([&]() {
+            RunSimulation(simulation, [&](const FrameInput& input) {
+                SetProfilerCapture(simulationProfiler, simulation.capturing.load(std::memory_order_relaxed));
+                BeginProfileFrame(simulationProfiler);
+                BeginStatsFrame(simulationStats);
+                FrameInput steps[SIMULATION_MAX_SUBSTEPS];
+                int stepCount = SplitFrameInput(input, steps);
+                for (int i = 0; i < stepCount; i++) {
+                    ResetFrameArena(simulationArena);
+                    simulateFrame(steps[i], steps[i].deltaTime, simulationProfiler, simulationStats, simulationArena);
                 }
                 
-                // Update blocks physics
-                for (size_t i = 0; i < blocks.size(); i++) {
-                    if (!blocks[i].isStatic) {
-                        // Apply friction
-                        blocks[i].velocity.x *= friction;
-                        blocks[i].velocity.z *= friction;
-                        
-                        // Apply gravity
-                        blocks[i].velocity.y -= blockGravity * deltaTime;
-                        
-                        // Update position
-                        Vector3 oldBlockPos = blocks[i].position;
-                        blocks[i].position = Vector3Add(blocks[i].position, 
-                            Vector3Scale(blocks[i].velocity, deltaTime));
-                        
-                        // Ground collision for blocks
-                        if (blocks[i].position.y <= 1.0f) {
-                            float impactSpeed = fabs(blocks[i].velocity.y);
-                            blocks[i].position.y = 1.0f;
-                            blocks[i].velocity.y = 0.0f;
-                            
-                            // Damage from ground impact
-                            if (impactSpeed > damageThreshold) {
-                                blocks[i].health -= (impactSpeed - damageThreshold) * damageMultiplier;
-                            }
-                        }
-                        
-                        // Block-to-block collision with damage
-                        BoundingBox box1 = GetBlockBoundingBox(blocks[i], blockSize);
-                        for (size_t j = 0; j < blocks.size(); j++) {
-                            if (i != j) {
-                                BoundingBox box2 = GetBlockBoundingBox(blocks[j], blockSize);
-                                if (CheckCollisionBoxes(box1, box2)) {
-                                    // Calculate collision velocity (impact force)
-                                    Vector3 relativeVel = Vector3Subtract(blocks[i].velocity, blocks[j].velocity);
-                                    float impactSpeed = Vector3Length(relativeVel);
-                                    
-                                    // Apply damage if collision is rough enough
-                                    if (impactSpeed > damageThreshold) {
-                                        float damage = (impactSpeed - damageThreshold) * damageMultiplier;
-                                        blocks[i].health -= damage;
-                                        if (!blocks[j].isStatic) {
-                                            blocks[j].health -= damage;
-                                        }
-                                    }
-                                    
-                                    // Collision response
-                                    blocks[i].position = oldBlockPos;
-                                    blocks[i].velocity.x *= -0.5f;
-                                    blocks[i].velocity.z *= -0.5f;
-                                }
-                            }
-                        }
-                        
-                        // Stop very slow blocks
-                        if (fabs(blocks[i].velocity.x) < 0.01f) blocks[i].velocity.x = 0;
-                        if (fabs(blocks[i].velocity.z) < 0.01f) blocks[i].velocity.z = 0;
-                    }
+                RenderSnapshot& snapshot = simulation.snapshots.slots[simulation.snapshots.back];
+                captureSnapshot(snapshot, fpCamera);
+                for (int i = 0; i < STAT_COUNT; i++) {
+                    if (!statInfo[i].isGauge) simulation.counted[i] += simulationStats.values[i];
+                    snapshot.stats[i] = statInfo[i].isGauge ? simulationStats.values[i] : simulation.counted[i];
                 }
-                
-                // Remove destroyed blocks
-                for (int i = blocks.size() - 1; i >= 0; i--) {
-                    if (blocks[i].health <= 0) {
-                        blocks.erase(blocks.begin() + i);
+                for (int p = 0; p < PHASE_COUNT; p++) snapshot.phases[p] = simulationProfiler.current[p];
+                EndProfileFrame(simulationProfiler);
+                EndStatsFrame(simulationStats, 0.0, 0.0f);
+                PublishSnapshot(simulation.snapshots);
+            });
+        });
+    }
+    
+    while (!WindowShouldClose() && !exitRequested) {
+        FrameInput input;
+        if (inputStream.replaying) {
+            if (!ReadFrameInput(inputStream, input)) break; // End of replay
+        } else {
+            input = CaptureFrameInput();
+            if (inputStream.recording) WriteFrameInput(inputStream, input);
+        }
+        
+        ResetFrameArena(frameArena);
+        BeginProfileFrame(profiler);
+        BeginStatsFrame(stats);
+        // Deterministic runs never read the frame time
+        float deltaTime = checksum.enabled ? checksum.fixedStep : input.deltaTime;
+        
+        BeginProfilePhase(profiler, PHASE_INPUT);
+        
+        // Profiler controls
+        if (IsKeyPressed(KEY_F3)) profiler.showOverlay = !profiler.showOverlay;
+        if (IsKeyPressed(KEY_F4)) {
+            if (profiler.capturing) {
+                CollectSimulationTrace(simulation, profiler, simulationProfiler);
+                SaveProfilerTrace(profiler, traceFileName);
+                profiler.trace.clear();
+            }
+            SetProfilerCapture(profiler, !profiler.capturing);
+            simulation.capturing.store(profiler.capturing, std::memory_order_relaxed);
+        }
+        if (IsKeyPressed(KEY_F5)) {
+            if (stats.csv) {
+                StopStatsCsv(stats);
+            } else {
+                StartStatsCsv(stats, statsFileName);
+            }
+        }
+        
+        // Toggle pause menu with TAB
+        if (IsInputKeyPressed(input, KEY_TAB)) {
+            isPaused = !isPaused;
+            if (isPaused) {
+                EnableCursor();
+            } else {
+                DisableCursor();
+            }
+        }
+        
+        EndProfilePhase(profiler, PHASE_INPUT);
+        
+        // The simulation only runs in normal mode; the editor and the pause menu
+        // touch the world themselves, so it is parked first
+        bool simulating = !isPaused && currentMode == NORMAL_MODE;
+        if (threaded) {
+            if (simulating) {
+                ResumeSimulation(simulation);
+            } else {
+                ParkSimulation(simulation);
+            }
+        }
+        
+        // Update based on mode and pause state
+        if (!isPaused) {
+            if (currentMode == NORMAL_MODE) {
+                if (threaded) {
+                    QueueSimulationInput(simulation, input);
+                } else {
+                    // Same step bound as the simulation thread
+                    FrameInput frame = input;
+                    frame.deltaTime = deltaTime;
+                    FrameInput steps[SIMULATION_MAX_SUBSTEPS];
+                    int stepCount = SplitFrameInput(frame, steps);
+                    for (int i = 0; i < stepCount; i++) {
+                        simulateFrame(steps[i], steps[i].deltaTime, profiler, stats, frameArena);
                     }
                 }
                 
-                // Update first-person camera
-                fpCamera.position = playerPosition;
-                fpCamera.target = (Vector3){
-                    playerPosition.x + sinf(cameraYaw),
-                    playerPosition.y + cameraPitch,
-                    playerPosition.z + cosf(cameraYaw)
-                };
-                
             } else if (currentMode == WORLD_EDITING_MODE) {
                 // World editing mode
+                BeginProfilePhase(profiler, PHASE_EDITOR);
                 Vector3 moveDir = { 0.0f, 0.0f, 0.0f };
                 
-                if (IsKeyDown(KEY_W)) moveDir.z -= 1.0f;
-                if (IsKeyDown(KEY_S)) moveDir.z += 1.0f;
-                if (IsKeyDown(KEY_A)) moveDir.x -= 1.0f;
-                if (IsKeyDown(KEY_D)) moveDir.x += 1.0f;
+                if (IsInputKeyDown(input, KEY_W)) moveDir.z -= 1.0f;
+                if (IsInputKeyDown(input, KEY_S)) moveDir.z += 1.0f;
+                if (IsInputKeyDown(input, KEY_A)) moveDir.x -= 1.0f;
+                if (IsInputKeyDown(input, KEY_D)) moveDir.x += 1.0f;
                 
                 if (Vector3Length(moveDir) > 0) {
                     moveDir = Vector3Normalize(moveDir);
@@ -378,218 +4722,399 @@ int main() {
                     editCameraPosition.z 
                 };
                 
-                // Mouse picking
-                Ray ray = GetScreenToWorldRay(GetMousePosition(), editCamera);
-                float t = -ray.position.y / ray.direction.y;
-                Vector3 groundPoint = {
-                    ray.position.x + ray.direction.x * t,
-                    0.0f,
-                    ray.position.z + ray.direction.z * t
-                };
+                // Height layer
+                if (IsInputKeyPressed(input, KEY_E)) editLayer++;
+                if (IsInputKeyPressed(input, KEY_Q) && editLayer > 0) editLayer--;
+                float layerY = blockSize.y/2 + editLayer * blockSize.y;
                 
-                Vector3 snappedPos = {
-                    roundf(groundPoint.x),
-                    1.0f,
-                    roundf(groundPoint.z)
-                };
+                // Mouse picking against block surfaces, falling back to the active layer
+                Ray ray = GetScreenToWorldRay(input.mousePosition, editCamera);
+                BlockHit pick = RaycastWorld(blocks, blockGrid, staticWorld, ray, editPickDistance, blockSize);
+                hoveredBlock = pick.index;
+                hoveredStatic = pick.isStatic;
+                hoveredCenter = pick.center;
+                
+                if (strokeActive) {
+                    // Strokes and drags stay on the layer they started on
+                    snappedPos = GetLayerPoint(ray, strokeY, blockSize);
+                } else if (pick.index >= 0) {
+                    // Against the face that was hit: on top of or beside the block
+                    snappedPos = Vector3Add(pick.center, Vector3Multiply(pick.normal, blockSize));
+                } else {
+                    snappedPos = GetLayerPoint(ray, layerY, blockSize);
+                }
+                
+                // Tool selection; switching ends the stroke or drag in progress
+                EditTool previousTool = editTool;
+                if (IsInputKeyPressed(input, KEY_ONE)) editTool = TOOL_BRUSH;
+                if (IsInputKeyPressed(input, KEY_TWO)) editTool = TOOL_FILL_RECT;
+                if (IsInputKeyPressed(input, KEY_THREE)) editTool = TOOL_FILL_VOLUME;
+                if (editTool != previousTool) {
+                    if (editHistory.groupOpen) EndEditGroup(editHistory);
+                    isDragging = false;
+                    strokeActive = false;
+                }
+                if (editTool == TOOL_FILL_VOLUME) {
+                    fillLayers = (int)Clamp(fillLayers + (int)input.mouseWheel, 1.0f, 64.0f);
+                }
                 
-                // Add block
-                if (IsMouseButtonPressed(MOUSE_LEFT_BUTTON)) {
-                    bool blockExists = false;
-                    for (const auto& block : blocks) {
-                        if (Vector3Distance(block.position, snappedPos) < 0.1f) {
-                            blockExists = true;
-                            break;
+                if (editTool == TOOL_BRUSH) {
+                    // Brush strokes: everything painted while a button is held is one undo entry
+                    if (IsInputButtonPressed(input, MOUSE_LEFT_BUTTON) || IsInputButtonPressed(input, MOUSE_RIGHT_BUTTON)) {
+                        if (!editHistory.groupOpen) BeginEditGroup(editHistory);
+                    }
+                    if (IsInputButtonPressed(input, MOUSE_LEFT_BUTTON)) {
+                        strokeActive = true;
+                        strokeY = snappedPos.y;
+                    }
+                    
+                    // Add block
+                    if (IsInputButtonDown(input, MOUSE_LEFT_BUTTON)) {
+                        if (FindBlockAt(blocks, blockGrid, snappedPos) < 0 && 
+                            !IsPointInStaticBlock(staticWorld, snappedPos)) {
+                            Color colors[] = { RED, BLUE, GREEN, YELLOW, PURPLE, ORANGE, PINK, LIME };
+                            Block block = { snappedPos, {0,0,0}, colors[GetRandomValue(0, 7)], false, 100.0f, 100.0f };
+                            RecordEditOp(editHistory, EDIT_ADD, (int)blocks.size(), block);
+                            AddBlock(blocks, blockGrid, block);
+                        }
+                    }
+                    
+                    // Remove block
+                    if (IsInputButtonDown(input, MOUSE_RIGHT_BUTTON) && hoveredBlock >= 0) {
+                        StaticBlock hovered;
+                        if (hoveredStatic && FindStaticBlock(staticWorld, hoveredCenter, &hovered)) {
+                            RecordEditOp(editHistory, EDIT_REMOVE, 0, UnpackStaticBlock(staticWorld, hovered));
+                            RemoveStaticBlock(staticWorld, hoveredCenter);
+                        } else if (!hoveredStatic) {
+                            RecordEditOp(editHistory, EDIT_REMOVE, hoveredBlock, blocks[hoveredBlock]);
+                            RemoveBlock(blocks, blockGrid, hoveredBlock);
                         }
+                        hoveredBlock = -1;
                     }
                     
-                    if (!blockExists) {
-                        Color colors[] = { RED, BLUE, GREEN, YELLOW, PURPLE, ORANGE, PINK, LIME };
-                        blocks.push_back({ snappedPos, {0,0,0}, colors[GetRandomValue(0, 7)], false, 100.0f, 100.0f });
+                    if (!IsInputButtonDown(input, MOUSE_LEFT_BUTTON)) strokeActive = false;
+                } else {
+                    // Region tools: drag out a box, commit it on release (LMB fills, RMB erases)
+                    if (!isDragging && (IsInputButtonPressed(input, MOUSE_LEFT_BUTTON) || IsInputButtonPressed(input, MOUSE_RIGHT_BUTTON))) {
+                        isDragging = true;
+                        dragErase = IsInputButtonPressed(input, MOUSE_RIGHT_BUTTON);
+                        // Erasing starts from the block under the cursor, filling from the free slot
+                        dragStart = (dragErase && hoveredBlock >= 0) ? hoveredCenter : snappedPos;
+                        strokeActive = true;
+                        strokeY = dragStart.y;
                     }
-                }
-                
-                // Remove block
-                if (IsMouseButtonPressed(MOUSE_RIGHT_BUTTON)) {
-                    for (int i = blocks.size() - 1; i >= 0; i--) {
-                        if (Vector3Distance(blocks[i].position, snappedPos) < 0.1f) {
-                            blocks.erase(blocks.begin() + i);
-                            break;
+                    
+                    if (isDragging && IsInputButtonReleased(input, dragErase ? MOUSE_RIGHT_BUTTON : MOUSE_LEFT_BUTTON)) {
+                        short steps[3];
+                        GetFillSteps(dragStart, snappedPos, editTool == TOOL_FILL_VOLUME ? fillLayers : 1, blockSize, steps);
+                        
+                        if (!dragErase) {
+                            Color colors[] = { RED, BLUE, GREEN, YELLOW, PURPLE, ORANGE, PINK, LIME };
+                            Block block = { dragStart, {0,0,0}, colors[GetRandomValue(0, 7)], false, 100.0f, 100.0f };
+                            int added = FillBlockRegion(blocks, blockGrid, staticWorld, block, steps, blockSize);
+                            if (added > 0) {
+                                EditOp* op = RecordEditOp(editHistory, EDIT_FILL, added, block);
+                                if (op) {
+                                    op->steps[0] = steps[0];
+                                    op->steps[1] = steps[1];
+                                    op->steps[2] = steps[2];
+                                }
+                            }
+                        } else {
+                            BoundingBox bounds = GetFillBounds(dragStart, steps, blockSize);
+                            CollectBlocksInRegion(blocks, blockGrid, bounds.min, bounds.max, regionBlocks);
+                            BeginEditGroup(editHistory);
+                            for (int index : regionBlocks) {
+                                RecordEditOp(editHistory, EDIT_REMOVE, index, blocks[index]);
+                                RemoveBlock(blocks, blockGrid, index);
+                            }
+                            regionStaticBlocks.clear();
+                            ForEachStaticBlockInBox(staticWorld, bounds.min, bounds.max, [&](const StaticBlock& block) {
+                                Vector3 p = GetBlockCenter(block);
+                                if (p.x >= bounds.min.x && p.x <= bounds.max.x && p.y >= bounds.min.y && 
+                                    p.y <= bounds.max.y && p.z >= bounds.min.z && p.z <= bounds.max.z) {
+                                    regionStaticBlocks.push_back(block);
+                                }
+                            });
+                            for (const StaticBlock& block : regionStaticBlocks) {
+                                RecordEditOp(editHistory, EDIT_REMOVE, 0, UnpackStaticBlock(staticWorld, block));
+                                RemoveStaticBlock(staticWorld, GetBlockCenter(block));
+                            }
+                            EndEditGroup(editHistory);
+                            hoveredBlock = -1;
                         }
+                        isDragging = false;
+                        strokeActive = false;
                     }
                 }
                 
+                // A stroke ends once both buttons are up, whichever tool is active
+                if (editHistory.groupOpen && 
+                    !IsInputButtonDown(input, MOUSE_LEFT_BUTTON) && !IsInputButtonDown(input, MOUSE_RIGHT_BUTTON)) {
+                    EndEditGroup(editHistory);
+                }
+                
                 // Toggle static
-                if (IsMouseButtonPressed(MOUSE_MIDDLE_BUTTON)) {
-                    for (auto& block : blocks) {
-                        if (Vector3Distance(block.position, snappedPos) < 0.1f) {
-                            block.isStatic = !block.isStatic;
-                            if (block.isStatic) {
-                                block.maxHealth = block.health = 1000.0f;
-                            } else {
-                                block.maxHealth = block.health = 100.0f;
-                            }
-                            break;
+                if (IsInputButtonPressed(input, MOUSE_MIDDLE_BUTTON) && hoveredBlock >= 0) {
+                    StaticBlock hovered;
+                    bool found = !hoveredStatic || FindStaticBlock(staticWorld, hoveredCenter, &hovered);
+                    if (found) {
+                        Block before = hoveredStatic ? UnpackStaticBlock(staticWorld, hovered) : blocks[hoveredBlock];
+                        // Refused when another static block already occupies the voxel
+                        if (ToggleStoredBlock(blocks, blockGrid, staticWorld, hoveredBlock, before)) {
+                            RecordEditOp(editHistory, EDIT_TOGGLE_STATIC, hoveredBlock, before);
                         }
                     }
+                    hoveredBlock = -1;
+                }
+                
+                // Undo / redo (CTRL+Z, CTRL+Y or CTRL+SHIFT+Z)
+                bool ctrlDown = IsInputKeyDown(input, KEY_LEFT_CONTROL) || IsInputKeyDown(input, KEY_RIGHT_CONTROL);
+                bool shiftDown = IsInputKeyDown(input, KEY_LEFT_SHIFT) || IsInputKeyDown(input, KEY_RIGHT_SHIFT);
+                if (ctrlDown && !editHistory.groupOpen && !isDragging) {
+                    if (IsInputKeyPressed(input, KEY_Z) && !shiftDown) {
+                        UndoEdit(editHistory, blocks, blockGrid, staticWorld);
+                        hoveredBlock = -1;
+                    } else if (IsInputKeyPressed(input, KEY_Y) || (IsInputKeyPressed(input, KEY_Z) && shiftDown)) {
+                        RedoEdit(editHistory, blocks, blockGrid, staticWorld, blockSize);
+                        hoveredBlock = -1;
+                    }
+                }
+                
+                // Benchmark scene from the same seed as --generate; too big to undo
+                if (IsInputKeyPressed(input, KEY_G) && !ctrlDown && !editHistory.groupOpen && !isDragging) {
+                    GenerateScene(sceneConfig, blocks, blockGrid, staticWorld, blockSize);
+                    ClearEditHistory(editHistory);
+                    
+                    // Flatten the terrain under the scene; heights and meshes are rebuilt as needed
+                    terrainShape.flatRadius = GetSceneFlatRadius(sceneConfig, blockSize);
+                    InitTerrainHeights(terrain, terrainShape);
+                    UnloadTerrainRenderer(terrainRenderer);
+                    InitTerrainRenderer(terrainRenderer, terrainShape, terrainRenderer.drawDistance);
+                    InvalidateGroundProbe(groundProbe);
+                    hoveredBlock = -1;
+                    
+                    // Nothing from the old world carries over: the player starts at the spawn, as with --generate
+                    playerPosition = GetSceneSpawn(sceneConfig, blockSize, playerHeight);
+                    playerVelocity = (Vector3){ 0.0f, 0.0f, 0.0f };
+                    isGrounded = false;
+                    fpCamera.position = playerPosition;
+                    fpCamera.target = Vector3Add(playerPosition, (Vector3){ 0.0f, 0.0f, 1.0f });
+                    debris.count = 0;
+                    ClearContactCache(contactSolver);
+                }
+                EndProfilePhase(profiler, PHASE_EDITOR);
+            }
+        } else {
+            // Pause menu
+            UiAction action = UpdateUiMenu(pauseMenu, input);
+            if (action == UI_NORMAL_MODE) {
+                // Simulation moves and destroys blocks, so edit deltas no longer apply
+                if (currentMode != NORMAL_MODE) {
+                    ClearEditHistory(editHistory);
+                    // Edits renumber blocks, so every block starts awake again
+                    ResetSupportGraph(supportGraph, blocks.size());
+                }
+                currentMode = NORMAL_MODE;
+                isPaused = false;
+                DisableCursor();
+            }
+            
+            if (action == UI_EDIT_MODE) {
+                // The editor works on the whole world
+                StreamInAllStaticRegions(staticWorld, streamer);
+                // Nothing held before the menu opened carries over
+                if (editHistory.groupOpen) EndEditGroup(editHistory);
+                isDragging = false;
+                strokeActive = false;
+                currentMode = WORLD_EDITING_MODE;
+                isPaused = false;
+                EnableCursor();
+            }
+            
+            if (action == UI_CONTINUE) {
+                isPaused = false;
+                if (currentMode == NORMAL_MODE) {
+                    DisableCursor();
+                } else {
+                    EnableCursor();
                 }
             }
+            
+            if (action == UI_EXIT) {
+                exitRequested = true;
+            }
+        }
+        
+        if (headless) {
+            EndFrameTelemetry(profiler, stats, frameArena, blocks.size() + staticWorld.blockCount);
+            continue;
+        }
+        
+        // Drawing reads only the snapshot: the simulation's newest one, or the
+        // live world captured here while the simulation is parked or inline
+        RenderSnapshot* snapshot = &simulation.snapshots.slots[simulation.snapshots.front];
+        if (threaded && simulating) {
+            if (AcquireSnapshot(simulation.snapshots)) {
+                snapshot = &simulation.snapshots.slots[simulation.snapshots.front];
+                MergeSimulationTelemetry(profiler, stats, simulation.merged, *snapshot);
+            }
+        } else {
+            captureSnapshot(*snapshot, (currentMode == NORMAL_MODE) ? fpCamera : editCamera);
         }
         
-        // Drawing
         BeginDrawing();
             ClearBackground(SKYBLUE);
             
-            Camera3D* activeCamera = (currentMode == NORMAL_MODE) ? &fpCamera : &editCamera;
+            Camera3D camera = snapshot->camera;
             
-            BeginMode3D(*activeCamera);
+            BeginProfilePhase(profiler, PHASE_DRAW_3D);
+            BeginMode3D(camera);
                 // Draw ground
-                DrawPlane((Vector3){ 0.0f, 0.0f, 0.0f }, 
-                    (Vector2){ 50.0f, 50.0f }, DARKGREEN);
-                DrawGrid(50, 1.0f);
+                CountStat(stats, STAT_DRAW_CALLS, 
+                    DrawTerrain(terrainRenderer, camera, (float)screenWidth / screenHeight, terrainScratch));
+                // The editor grid lies on the floor of the layer being edited and
+                // shows through terrain, which is rarely flat at 0 far from the scene
+                groundGrid.height = (currentMode == WORLD_EDITING_MODE) ? editLayer * blockSize.y : 0.0f;
+                groundGrid.overlay = currentMode == WORLD_EDITING_MODE;
+                CountStat(stats, STAT_DRAW_CALLS, DrawGroundGrid(groundGrid, camera));
                 
-                // Draw all blocks with health indication
-                for (const auto& block : blocks) {
-                    Color drawColor = block.color;
-                    if (block.isStatic) {
-                        drawColor = Fade(block.color, 0.7f);
-                    }
-                    
-                    DrawCube(block.position, blockSize.x, blockSize.y, blockSize.z, drawColor);
-                    DrawCubeWires(block.position, blockSize.x, blockSize.y, blockSize.z, 
-                        block.isStatic ? GRAY : BLACK);
-                    
-                    // Draw health bar above block
-                    if (!block.isStatic && currentMode == NORMAL_MODE) {
-                        Vector3 barPos = { block.position.x, block.position.y + 1.5f, block.position.z };
-                        float healthPercent = block.health / block.maxHealth;
-                        Color healthColor = GetHealthColor(block.health, block.maxHealth);
-                        
-                        // Background bar
-                        DrawCube(barPos, 1.5f, 0.1f, 0.1f, DARKGRAY);
-                        // Health bar
-                        DrawCube((Vector3){barPos.x - 0.75f + (0.75f * healthPercent), barPos.y, barPos.z}, 
-                                1.5f * healthPercent, 0.12f, 0.12f, healthColor);
-                    }
+                // Draw all blocks, static ones faded
+                CountStat(stats, STAT_DRAW_CALLS, DrawRenderBlocks(snapshot->blocks, blockSize));
+                CountStat(stats, STAT_DRAW_CALLS, DrawDebris(snapshot->debris, camera));
+                
+                // Crosshair target highlight
+                if (currentMode == NORMAL_MODE && snapshot->targetBlock >= 0) {
+                    DrawCubeWires(snapshot->targetCenter, 
+                        blockSize.x * 1.02f, blockSize.y * 1.02f, blockSize.z * 1.02f, WHITE);
+                    CountStat(stats, STAT_DRAW_CALLS);
                 }
                 
                 // Preview in edit mode
                 if (currentMode == WORLD_EDITING_MODE && !isPaused) {
-                    Ray ray = GetScreenToWorldRay(GetMousePosition(), editCamera);
-                    float t = -ray.position.y / ray.direction.y;
-                    Vector3 groundPoint = {
-                        ray.position.x + ray.direction.x * t,
-                        0.0f,
-                        ray.position.z + ray.direction.z * t
-                    };
-                    Vector3 previewPos = {
-                        roundf(groundPoint.x),
-                        1.0f,
-                        roundf(groundPoint.z)
-                    };
-                    DrawCube(previewPos, blockSize.x, blockSize.y, blockSize.z, Fade(WHITE, 0.3f));
-                    DrawCubeWires(previewPos, blockSize.x, blockSize.y, blockSize.z, WHITE);
+                    Vector3 previewPos = snappedPos;
+                    
+                    if (hoveredBlock >= 0 && !isDragging) {
+                        DrawCubeWires(hoveredCenter, 
+                            blockSize.x * 1.02f, blockSize.y * 1.02f, blockSize.z * 1.02f, YELLOW);
+                    }
+                    
+                    if (isDragging) {
+                        short steps[3];
+                        GetFillSteps(dragStart, previewPos, editTool == TOOL_FILL_VOLUME ? fillLayers : 1, blockSize, steps);
+                        BoundingBox bounds = GetFillBounds(dragStart, steps, blockSize);
+                        Vector3 size = Vector3Subtract(bounds.max, bounds.min);
+                        Vector3 center = Vector3Add(bounds.min, Vector3Scale(size, 0.5f));
+                        DrawCube(center, size.x, size.y, size.z, Fade(dragErase ? RED : WHITE, 0.2f));
+                        DrawBoundingBox(bounds, dragErase ? RED : WHITE);
+                    } else {
+                        DrawCube(previewPos, blockSize.x, blockSize.y, blockSize.z, Fade(WHITE, 0.3f));
+                        DrawCubeWires(previewPos, blockSize.x, blockSize.y, blockSize.z, WHITE);
+                    }
+                    CountStat(stats, STAT_DRAW_CALLS, 2);
                 }
                 
             EndMode3D();
             
+            // Health bars of damaged blocks, as one screen-space batch
+            if (currentMode == NORMAL_MODE) {
+                HealthBar* healthBars;
+                int barCount = CollectHealthBars(snapshot->blocks, camera, healthBarDistance, healthBarSize, frameArena, &healthBars);
+                CountStat(stats, STAT_DRAW_CALLS, DrawHealthBars(healthBars, barCount, healthBarSize));
+            }
+            EndProfilePhase(profiler, PHASE_DRAW_3D);
+            
+            BeginProfilePhase(profiler, PHASE_DRAW_HUD);
             if (!isPaused) {
                 if (currentMode == NORMAL_MODE) {
-                    DrawText("NORMAL MODE", 10, 10, 20, DARKGRAY);
-                    DrawText("WASD - Move | SPACE - Jump | E - Kick | TAB - Pause", 10, 40, 20, DARKGRAY);
-                    DrawText("Kick blocks to damage them! Blocks break on hard impacts!", 10, 70, 20, GREEN);
-                    DrawText(TextFormat("Position: (%.1f, %.1f, %.1f)", 
-                        playerPosition.x, playerPosition.y, playerPosition.z), 10, 100, 20, DARKGRAY);
+                    // Shown to one decimal, so only a change at that precision needs new text
+                    Vector3 position = snapshot->playerPosition;
+                    if (HudLabelValuesChanged(hudText, positionLabel, roundf(position.x * 10.0f), 
+                            roundf(position.y * 10.0f), roundf(position.z * 10.0f))) {
+                        SetHudLabelText(hudText, positionLabel, TextFormat("Position: (%.1f, %.1f, %.1f)", 
+                            position.x, position.y, position.z));
+                    }
                     
                     // Kick cooldown indicator
-                    if (kickCooldown > 0) {
-                        DrawText(TextFormat("Kick Cooldown: %.1fs", kickCooldown), 10, 130, 20, RED);
-                    } else {
-                        DrawText("Kick Ready!", 10, 130, 20, GREEN);
+                    float cooldown = snapshot->kickCooldown;
+                    if (HudLabelValuesChanged(hudText, kickLabel, (cooldown > 0) ? roundf(cooldown * 10.0f) : -1.0f)) {
+                        if (cooldown > 0) {
+                            SetHudLabelText(hudText, kickLabel, TextFormat("Kick Cooldown: %.1fs", cooldown));
+                            hudText.labels[kickLabel].color = RED;
+                        } else {
+                            SetHudLabelText(hudText, kickLabel, "Kick Ready!");
+                            hudText.labels[kickLabel].color = GREEN;
+                        }
+                    }
+                    CountStat(stats, STAT_DRAW_CALLS, DrawHudText(hudText, HUD_NORMAL));
+                    
+                    // Crosshair
+                    DrawLine(screenWidth/2 - 8, screenHeight/2, screenWidth/2 + 8, screenHeight/2, WHITE);
+                    DrawLine(screenWidth/2, screenHeight/2 - 8, screenWidth/2, screenHeight/2 + 8, WHITE);
+                } else {
+                    int totalBlocks = (int)(blocks.size() + staticWorld.blockCount);
+                    if (HudLabelValuesChanged(hudText, blockCountLabel, (float)totalBlocks, (float)staticWorld.blockCount)) {
+                        SetHudLabelText(hudText, blockCountLabel, TextFormat("Blocks: %d (%d static) | TAB - Pause", 
+                            totalBlocks, (int)staticWorld.blockCount));
+                    }
+                    if (HudLabelValuesChanged(hudText, historyLabel, (float)editHistory.applied, (float)editHistory.count)) {
+                        SetHudLabelText(hudText, historyLabel, TextFormat("CTRL+Z - Undo | CTRL+Y - Redo | History: %d/%d", 
+                            (int)editHistory.applied, (int)editHistory.count));
                     }
+                    if (HudLabelValuesChanged(hudText, toolLabel, (float)editTool, (float)fillLayers, (float)editLayer)) {
+                        const char* toolNames[] = { "Brush", "Rect Fill", "Volume Fill" };
+                        SetHudLabelText(hudText, toolLabel, TextFormat("1/2/3 - Tool: %s | Wheel - Layers: %d | Q/E - Height Layer: %d", 
+                            toolNames[editTool], fillLayers, editLayer));
+                    }
+                    CountStat(stats, STAT_DRAW_CALLS, DrawHudText(hudText, HUD_EDITOR));
+                }
+                if (profiler.showOverlay) {
+                    CountStat(stats, STAT_DRAW_CALLS, DrawProfilerOverlay(profiler, hudText, profilerLabels, screenWidth - 330, 10, 320));
+                    CountStat(stats, STAT_DRAW_CALLS, DrawFrameStats(stats, hudText, statsLabels, screenWidth - 510, 10));
                 } else {
-                    DrawText("WORLD EDITING MODE (W/S Inverted)", 10, 10, 25, ORANGE);
-                    DrawText("WASD - Move | LMB - Add | RMB - Remove | MMB - Toggle Static", 
-                        10, 40, 20, DARKGRAY);
-                    DrawText(TextFormat("Blocks: %d | TAB - Pause", blocks.size()), 10, 70, 20, DARKGRAY);
-                    DrawText("Faded blocks are STATIC (can't be broken)", 10, 100, 18, GRAY);
+                    // DrawFPS's colours, without formatting every frame
+                    int fps = GetFPS();
+                    if (HudLabelValuesChanged(hudText, fpsLabel, (float)fps)) {
+                        hudText.labels[fpsLabel].color = (fps < 15) ? RED : (fps < 30) ? ORANGE : LIME;
+                        SetHudLabelText(hudText, fpsLabel, TextFormat("%2i FPS", fps));
+                    }
+                    CountStat(stats, STAT_DRAW_CALLS, DrawHudText(hudText, HUD_FPS));
                 }
-                DrawFPS(10, screenHeight - 30);
                 
             } else {
                 // Pause menu
                 DrawRectangle(0, 0, screenWidth, screenHeight, Fade(BLACK, 0.7f));
-                
-                const char* title = "PAUSED";
-                int titleWidth = MeasureText(title, 60);
-                DrawText(title, (screenWidth - titleWidth) / 2, 100, 60, WHITE);
-                
-                Button normalModeBtn = {
-                    (Rectangle){ screenWidth/2 - 150, 220, 300, 60 },
-                    "NORMAL MODE",
-                    DARKBLUE,
-                    BLUE
-                };
-                
-                Button editModeBtn = {
-                    (Rectangle){ screenWidth/2 - 150, 300, 300, 60 },
-                    "WORLD EDITING",
-                    DARKGREEN,
-                    GREEN
-                };
-                
-                Button continueBtn = {
-                    (Rectangle){ screenWidth/2 - 150, 380, 300, 60 },
-                    "CONTINUE",
-                    DARKPURPLE,
-                    PURPLE
-                };
-                
-                Button exitBtn = {
-                    (Rectangle){ screenWidth/2 - 150, 460, 300, 60 },
-                    "EXIT GAME",
-                    DARKGRAY,
-                    RED
-                };
-                
-                DrawButton(normalModeBtn);
-                DrawButton(editModeBtn);
-                DrawButton(continueBtn);
-                DrawButton(exitBtn);
-                
-                if (IsButtonClicked(normalModeBtn)) {
-                    currentMode = NORMAL_MODE;
-                    isPaused = false;
-                    DisableCursor();
-                }
-                
-                if (IsButtonClicked(editModeBtn)) {
-                    currentMode = WORLD_EDITING_MODE;
-                    isPaused = false;
-                    EnableCursor();
-                }
-                
-                if (IsButtonClicked(continueBtn)) {
-                    isPaused = false;
-                    if (currentMode == NORMAL_MODE) {
-                        DisableCursor();
-                    } else {
-                        EnableCursor();
-                    }
-                }
-                
-                if (IsButtonClicked(exitBtn)) {
-                    break;
-                }
-                
-                DrawText("TAB - Resume", screenWidth/2 - MeasureText("TAB - Resume", 20)/2, 
-                    570, 20, LIGHTGRAY);
+                CountStat(stats, STAT_DRAW_CALLS, 1 + DrawUiMenu(pauseMenu, hudText));
             }
+            CountStat(stats, STAT_TEXT_LAYOUTS, hudText.layouts);
+            hudText.layouts = 0;
+            EndProfilePhase(profiler, PHASE_DRAW_HUD);
             
         EndDrawing();
+        EndFrameTelemetry(profiler, stats, frameArena, snapshot->blockCount);
+    }
+    
+    if (inputStream.replaying) {
+        TraceLog(LOG_INFO, "REPLAY: %lld frames in %.2f s", inputStream.frames, GetTime() - runStart);
+    }
+    StopSimulation(simulation);
+    CloseInputStream(inputStream);
+    UnloadFrameArena(frameArena);
+    UnloadFrameArena(simulationArena);
+    UnloadUiMenu(pauseMenu);
+    UnloadTerrainRenderer(terrainRenderer);
+    UnloadGridRenderer(groundGrid);
+    if (checksum.log) fclose(checksum.log);
+    if (checksum.golden) fclose(checksum.golden);
+    
+    // Flush captures still running at exit
+    if (profiler.capturing) {
+        profiler.trace.insert(profiler.trace.end(), simulationProfiler.trace.begin(), simulationProfiler.trace.end());
+        SaveProfilerTrace(profiler, traceFileName);
     }
+    StopStatsCsv(stats);
     
     CloseWindow();
-    return 0;
+    return checksum.failed ? 1 : 0;
 }
 